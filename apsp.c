@@ -0,0 +1,315 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "apsp.h"
+#include "instrument.h"
+
+bool csr_is_unit_weight(const struct csr_graph *g) {
+    if (g->w == NULL)
+        return true;
+    for (int64_t e=0; e < g->nnz; e++)
+        if (g->w[e] != 1)
+            return false;
+    return true;
+}
+
+int csr_max_weight(const struct csr_graph *g) {
+    int heaviest = 1;
+    if (g->w != NULL)
+        for (int64_t e=0; e < g->nnz; e++)
+            if (g->w[e] > heaviest)
+                heaviest = g->w[e];
+    return heaviest;
+}
+
+enum engine engine_select(const struct csr_graph *g, bool whole_matrix) {
+    if (csr_is_unit_weight(g))
+        return ENGINE_BFS;
+    int heaviest = csr_max_weight(g);
+    double density = (double)g->nnz / ((double)g->n * g->n);
+    if (whole_matrix && g->n <= FW_MAX_NODES && density >= FW_MIN_DENSITY && (int64_t)(g->n - 1) * heaviest < FW_INF)
+        return ENGINE_FW;
+    if (heaviest <= DIAL_MAX_WEIGHT)
+        return ENGINE_DIAL;
+    return ENGINE_HEAP;
+}
+
+void apsp_input_init(struct apsp_input *in, enum engine e, const struct csr_graph *g, bool whole_matrix) {
+    in->n = g->n;
+    in->engine = (e == ENGINE_AUTO) ? engine_select(g, whole_matrix) : e;
+    if (in->engine == ENGINE_FW && !whole_matrix) {
+        printf("Floyd-Warshall needs the whole matrix in one place, using heap instead\n");
+        in->engine = ENGINE_HEAP;
+    }
+    in->max_weight = csr_max_weight(g);
+    // BFS counts hops, so on a weighted graph it would quietly give hop counts instead of distances
+    if (in->engine == ENGINE_BFS && !csr_is_unit_weight(g)) {
+        in->engine = in->max_weight <= DIAL_MAX_WEIGHT ? ENGINE_DIAL : ENGINE_HEAP;
+        printf("BFS ignores edge weights, using %s instead\n", engine_name(in->engine));
+    }
+    in->g = g;
+    // n-1 hops of the heaviest edge is as long as a shortest path can get
+    int64_t longest = (int64_t)(g->n - 1) * in->max_weight;
+    if (longest >= NC || (in->engine == ENGINE_FW && longest >= FW_INF))
+        printf("Warning: weights up to %d could make paths longer than %d, any that are will read as no path\n",
+               in->max_weight, in->engine == ENGINE_FW ? FW_INF - 1 : NC - 1);
+    in->dense.bits = NULL;
+    in->dense.w = NULL;
+    in->scc.comp = NULL;
+    in->scc.order = NULL;
+    in->scc.pos = NULL;
+    in->scc.first = NULL;
+    if (in->engine == ENGINE_DENSE && dense_adj_build(&in->dense, g))
+        exit(-1);
+}
+
+void apsp_input_free(struct apsp_input *in) {
+    dense_adj_free(&in->dense);
+    scc_free(&in->scc);
+}
+
+int apsp_scratch_prepare(const struct apsp_input *in, struct sssp_scratch *s) {
+    bool dense = in->engine == ENGINE_DENSE;
+    return scratch_reserve(s, dense && in->dense.bits ? in->dense.words : 0, in->engine == ENGINE_DIAL ? in->max_weight : 0,
+                           in->engine == ENGINE_BFS, dense && in->scc.comp != NULL);
+}
+
+struct sssp_scratch *apsp_scratch_create(const struct apsp_input *in) {
+    struct sssp_scratch *s = scratch_create(in->n);
+    if (s != NULL && apsp_scratch_prepare(in, s)) {
+        scratch_free(s);
+        return NULL;
+    }
+    return s;
+}
+
+void apsp_input_components(struct apsp_input *in) {
+    if (in->engine != ENGINE_DENSE && in->engine != ENGINE_HEAP && in->engine != ENGINE_DIAL)
+        return;
+    INSTR_BEGIN(mark, PHASE_GENERATE);
+    if (scc_compute(in->g, &in->scc))
+        exit(-1);
+    printf("Components: %d, largest %d nodes\n", in->scc.count, in->scc.largest);
+    if (in->scc.count == 1) {
+        // Everything reaches everything, there is nothing to skip
+        scc_free(&in->scc);
+        INSTR_END(mark, PHASE_GENERATE);
+        return;
+    }
+    if (in->engine == ENGINE_DENSE) {
+        // The dense layout is rebuilt on the relabeled graph, the relabeled CSR itself is only needed for that
+        struct csr_graph relabeled;
+        dense_adj_free(&in->dense);
+        if (scc_relabel(in->g, &in->scc, &relabeled) || dense_adj_build(&in->dense, &relabeled))
+            exit(-1);
+        csr_free(&relabeled);
+    }
+    INSTR_END(mark, PHASE_GENERATE);
+}
+
+int apsp_all(const struct apsp_input *in, struct dist_matrix *d, int nthreads) {
+    if (in->engine == ENGINE_FW) {
+        // The tiles need random access to full ints, so FW works in an int matrix and narrows at the end
+        // (FW is only picked for n <= FW_MAX_NODES, where that is at most 64MB)
+        int n = in->n;
+        int *dist = malloc(sizeof(int) * n * n);
+        if (dist == NULL) {
+            printf("APSP_ALL: not enough memory for a %d x %d Floyd-Warshall matrix\n", n, n);
+            return -1;
+        }
+        int rc = fw_all(in->g, dist, nthreads);
+        for (int i=0; i < n && rc == 0; i++)
+            dm_store_row(d, i, &dist[(size_t)i * n]);
+        free(dist);
+        return rc;
+    }
+    struct sssp_scratch *s = apsp_scratch_create(in);
+    if (s == NULL)
+        return -1;
+    if (in->scc.comp != NULL)
+        apsp_sources(in, in->scc.order, in->n, d, s);
+    else
+        apsp_rows(in, 0, in->n - 1, d, s);
+    scratch_free(s);
+    return 0;
+}
+
+int apsp_default_chunk(const struct apsp_input *in, int nsources, int nthreads) {
+    if (nthreads < 1)
+        nthreads = 1;
+    if (in->engine == ENGINE_BFS) {
+        int per_thread = (nsources + nthreads - 1) / nthreads;
+        int chunk = (per_thread + 63) / 64 * 64;
+        return chunk < MSBFS_BATCH ? chunk : MSBFS_BATCH;
+    }
+    int chunk = nsources / (nthreads * 16);
+    return chunk > 0 ? chunk : 1;
+}
+
+void dijkstra_some(void *job, int worker, int start, int end) {
+    struct apsp_job *my_data = (struct apsp_job *) job;
+    if (my_data->out != NULL)
+        result_file_rows(my_data->out, my_data->in, start, end, my_data->scratch[worker]);
+    else if (my_data->by_component && my_data->in->scc.comp != NULL)
+        apsp_sources(my_data->in, my_data->in->scc.order + start, end - start + 1, my_data->d, my_data->scratch[worker]);
+    else
+        apsp_rows(my_data->in, start, end, my_data->d, my_data->scratch[worker]);
+}
+
+/*
+With components, a node with no out edges reaches only itself, and the dense engine works on the
+relabeled graph from the first node of src's component on, so everything below it is filled in as NC
+*/
+void apsp_row(const struct apsp_input *in, int src, struct sssp_scratch *s) {
+    const struct scc *c = &in->scc;
+    int n = in->n;
+    int *row = s->row;
+    if (c->comp != NULL && in->g->off[src] == in->g->off[src+1]) {
+        for (int v=0; v < n; v++)
+            row[v] = NC;
+        row[src] = 0;
+        INSTR_ADD(INSTR_SETTLE, 1);
+        return;
+    }
+    switch (in->engine) {
+        case ENGINE_DENSE:
+            if (c->comp == NULL) {
+                dijkstra_one(&in->dense, src, 0, row, s);
+                break;
+            }
+            // The row is only known relabeled, it is put back in node order on the way out
+            int lo = c->first[c->comp[src]];
+            dijkstra_one(&in->dense, c->pos[src], lo, s->comp_row, s);
+            for (int k=0; k < lo; k++)
+                row[c->order[k]] = NC;
+            for (int k=lo; k < n; k++)
+                row[c->order[k]] = s->comp_row[k];
+            break;
+        case ENGINE_DIAL:
+            dijkstra_dial(in->g, in->max_weight, src, row, s, NULL);
+            break;
+        default:
+            dijkstra_heap(in->g, src, row, s, NULL);
+            break;
+    }
+}
+
+// apsp_row into row src of d. Heap and dial write d as they settle, the dense engine's row goes through dm_store_row
+static void apsp_store(const struct apsp_input *in, int src, struct dist_matrix *d, struct sssp_scratch *s) {
+    switch (in->engine) {
+        case ENGINE_DENSE:
+            apsp_row(in, src, s);
+            dm_store_row(d, src, s->row);
+            break;
+        case ENGINE_DIAL:
+            dijkstra_dial(in->g, in->max_weight, src, s->row, s, d);
+            break;
+        default:
+            dijkstra_heap(in->g, src, s->row, s, d);
+            break;
+    }
+}
+
+void apsp_sources(const struct apsp_input *in, const int *src, int count, struct dist_matrix *d, struct sssp_scratch *s) {
+    INSTR_BEGIN(mark, PHASE_COMPUTE);
+    for (int k=0; k < count; k++)
+        apsp_store(in, src[k], d, s);
+    INSTR_END(mark, PHASE_COMPUTE);
+}
+
+void apsp_rows(const struct apsp_input *in, int lo, int hi, struct dist_matrix *d, struct sssp_scratch *s) {
+    INSTR_BEGIN(mark, PHASE_COMPUTE);
+    if (in->engine == ENGINE_BFS) {
+        msbfs_rows(in->g, lo, hi, d, s);
+    } else {
+        for (int i=lo; i<=hi; i++)
+            apsp_store(in, i, d, s);
+    }
+    INSTR_END(mark, PHASE_COMPUTE);
+}
+
+/*
+One batch of MS-BFS, for the sources first : first+count-1 (count <= MSBFS_BATCH)
+Bit b of a node's words stands for source first+b
+seen = sources that have reached the node, frontier = sources that reached it on the last level
+Each level ORs the frontier of every node into next[] of its neighbors, then keeps only the bits
+that are new. A new bit b at node w means source first+b reaches w in exactly level hops
+Every level is one O(V+E) sweep for all of the sources together, instead of one per source
+The levels are stored straight into rows first : first+count-1 of d
+*/
+static void msbfs_batch(const struct csr_graph *g, int first, int count, struct dist_matrix *d, uint64_t *words) {
+    int n = g->n;
+    uint64_t (*seen)[MSBFS_WORDS] = (uint64_t (*)[MSBFS_WORDS]) words;
+    uint64_t (*frontier)[MSBFS_WORDS] = seen + n;
+    uint64_t (*next)[MSBFS_WORDS] = frontier + n;
+
+    memset(words, 0, sizeof(uint64_t[3][MSBFS_WORDS]) * n);
+    dm_begin_store(d, 0);
+    for (int b=0; b < count; b++) {
+        int src = first + b;
+        seen[src][b / 64] |= 1ULL << (b % 64);
+        frontier[src][b / 64] |= 1ULL << (b % 64);
+        for (int v=0; v < n; v++)
+            dm_set(d, src, v, NC);
+        dm_set(d, src, src, 0);
+    }
+    dm_end_store(d);
+
+    INSTR_LOCAL(scanned);
+    INSTR_LOCAL(relaxed);
+    INSTR_LOCAL(settled);
+    bool active = true;
+    for (int level=1; active; level++) {
+        // Push every frontier along its out edges
+        for (int v=0; v < n; v++) {
+            uint64_t any = 0;
+            for (int k=0; k < MSBFS_WORDS; k++)
+                any |= frontier[v][k];
+            if (!any)
+                continue;
+            INSTR_INC(scanned, 1);
+            INSTR_INC(relaxed, g->off[v+1] - g->off[v]);
+            for (int64_t e=g->off[v]; e < g->off[v+1]; e++) {
+                int w = g->adj[e];
+                for (int k=0; k < MSBFS_WORDS; k++)
+                    next[w][k] |= frontier[v][k];
+            }
+        }
+
+        // Keep the sources that had not already reached each node, they are the next frontier
+        // The width can only change between levels, so it is checked once per level, not per store
+        active = false;
+        dm_begin_store(d, level);
+        for (int w=0; w < n; w++) {
+            for (int k=0; k < MSBFS_WORDS; k++) {
+                uint64_t fresh = next[w][k] & ~seen[w][k];
+                next[w][k] = 0;
+                frontier[w][k] = fresh;
+                if (!fresh)
+                    continue;
+                seen[w][k] |= fresh;
+                active = true;
+                INSTR_INC(settled, __builtin_popcountll(fresh));
+                while (fresh) {
+                    int b = k*64 + __builtin_ctzll(fresh);
+                    dm_set(d, first + b, w, level);
+                    fresh &= fresh - 1;
+                }
+            }
+        }
+        dm_end_store(d);
+    }
+    // Each source is settled at itself before the first level
+    INSTR_ADD(INSTR_SCAN, scanned);
+    INSTR_ADD(INSTR_RELAX, relaxed);
+    INSTR_ADD(INSTR_SETTLE, settled + count);
+}
+
+void msbfs_rows(const struct csr_graph *g, int lo, int hi, struct dist_matrix *d, struct sssp_scratch *s) {
+    for (int first=lo; first <= hi; first += MSBFS_BATCH) {
+        int count = hi - first + 1;
+        if (count > MSBFS_BATCH)
+            count = MSBFS_BATCH;
+        msbfs_batch(g, first, count, d, s->bfs_words);
+    }
+}
@@ -0,0 +1,148 @@
+#ifndef APSP_H
+#define APSP_H
+
+#include "config.h"
+#include "distmat.h"
+#include "graph.h"
+#include "sssp.h"
+#include "fw.h"
+#include "resultfile.h"
+#include "scc.h"
+
+// Floyd-Warshall is only picked automatically for graphs this small and this dense
+// Past FW_MAX_NODES the n^3 term loses to n*(V+E)*log V even on dense graphs,
+// and under FW_MIN_DENSITY (edges / n^2) the heap dijkstra does much less work
+#define FW_MAX_NODES 4096
+#define FW_MIN_DENSITY 0.25
+// Dial's buckets are picked automatically when no edge is heavier than this
+// The buckets it walks past for nothing grow with the weights, while the heap's cost doesn't depend on them
+#ifndef DIAL_MAX_WEIGHT
+#define DIAL_MAX_WEIGHT 1024
+#endif
+
+/*
+The graph in every form the engines might need, plus which engine to use
+Built once in main and shared (read only) by every thread/process
+*/
+struct apsp_input {
+    int n;
+    enum engine engine; // never ENGINE_AUTO, apsp_input_init resolves it
+    const struct csr_graph *g;
+    int max_weight; // heaviest edge of g (1 when it has none), what ENGINE_DIAL sizes its buckets by
+    struct dense_adj dense; // only built for ENGINE_DENSE (on the relabeled graph when components are used)
+    struct scc scc; // comp is NULL unless apsp_input_components split the graph
+};
+
+// true when every edge has weight 1, so shortest paths are just hop counts
+bool csr_is_unit_weight(const struct csr_graph *g);
+// The heaviest edge, 1 for unit weight (or edgeless) graphs
+int csr_max_weight(const struct csr_graph *g);
+
+/*
+Picks the engine for ENGINE_AUTO
+1: unit weights -> BFS, which beats every other engine on hop counts
+2: small and dense, and the caller computes the whole matrix in one place -> Floyd-Warshall
+   (unless the longest possible path could reach FW_INF, which FW would report as no path)
+3: no edge heavier than DIAL_MAX_WEIGHT -> Dial's buckets
+4: otherwise -> heap dijkstra
+whole_matrix is false for loose, where every process only computes its own rows
+*/
+enum engine engine_select(const struct csr_graph *g, bool whole_matrix);
+
+/*
+Fills in an apsp_input, resolving ENGINE_AUTO and building whatever layout the engine needs from g
+An explicit bfs on a weighted graph is swapped for dial or heap, since it only counts hops
+Warns when the weights are heavy enough that a path could pass INT_MAX: every engine then reports
+that pair as NC (see dist_add) instead of overflowing
+*/
+void apsp_input_init(struct apsp_input *in, enum engine e, const struct csr_graph *g, bool whole_matrix);
+void apsp_input_free(struct apsp_input *in);
+
+/*
+Splits the graph into strongly connected components (see scc.h), once, for every source to share
+Only for the engines that run one source at a time (dense, heap, dial), and only when there is more than one
+component. Afterwards every row:
+    of a node with no out edges is filled in directly, with no search at all
+    on the dense engine is searched on the graph relabeled in component order, so a source in component c
+    scans and relaxes only the nodes from first[c] on, and the nodes below are filled with NC in one go
+Heap and dial already stop once the reachable nodes are settled, they gain from the order sources run in
+(see apsp_sources), where consecutive sources share most of what they reach
+*/
+void apsp_input_components(struct apsp_input *in);
+
+/*
+scratch_create plus whatever in's engine will need from the scratch (scratch_reserve), so apsp_rows,
+apsp_sources and apsp_row never allocate. After apsp_input_components, which can add to that. NULL on failure
+*/
+struct sssp_scratch *apsp_scratch_create(const struct apsp_input *in);
+// The same for a scratch that already exists (made for another input of the same n), returns 0 on success
+int apsp_scratch_prepare(const struct apsp_input *in, struct sssp_scratch *s);
+
+/*
+Computes the entire n*n dist matrix (d must hold every row)
+Floyd-Warshall runs on nthreads threads, every other engine just does rows 0:n-1 on this thread
+*/
+int apsp_all(const struct apsp_input *in, struct dist_matrix *d, int nthreads);
+
+/*
+Sources per chunk when splitting nsources over nthreads workers
+Roughly 16 chunks per thread leaves enough left over to steal when sources cost different amounts
+BFS wants whole batches (multiples of 64) so no bits of its words go to waste
+*/
+int apsp_default_chunk(const struct apsp_input *in, int nsources, int nthreads);
+
+/*
+Computes rows lo:hi (inclusive) of the all pairs result with the chosen engine, into d
+(which must hold those rows). Heap and dial store each distance into d as it settles, MS-BFS each level,
+and the dense dijkstra computes the row as ints in s->row and narrows it into d
+This is the one function serial, tight and loose all call, each with their own range of sources
+Not valid for ENGINE_FW, which can only compute the whole matrix (see apsp_all)
+*/
+void apsp_rows(const struct apsp_input *in, int lo, int hi, struct dist_matrix *d, struct sssp_scratch *s);
+
+/*
+Computes the single row of src into s->row as ints, with the engine when it runs one source at a time
+(dense, heap, dial), and with the heap dijkstra for the ones that don't (bfs, fw)
+*/
+void apsp_row(const struct apsp_input *in, int src, struct sssp_scratch *s);
+
+/*
+Same as apsp_rows, for the count sources listed in src instead of a range (d must hold every one of their rows)
+Not valid for ENGINE_FW or ENGINE_BFS, which need the sources as a range
+*/
+void apsp_sources(const struct apsp_input *in, const int *src, int count, struct dist_matrix *d, struct sssp_scratch *s);
+
+/*
+Everything a pool task needs, shared by all workers
+Each worker only ever touches its own scratch[worker]
+*/
+struct apsp_job {
+    struct dist_matrix *d; // Pointer to the dist rows for results (all of them in tight, its own in loose)
+    struct result_file *out; // When set (-o), the rows go to this file instead of d
+    const struct apsp_input *in; // Pointer to the graph (and which engine to run on it)
+    struct sssp_scratch **scratch; // One set of buffers per worker, reused for all of its chunks
+    // When set (and in has components), start:end are positions in in->scc.order rather than rows,
+    // so sources run component by component. Only for a d that holds every row, and no out
+    bool by_component;
+};
+
+/*
+This function is the one ran by the pool threads, once per chunk of sources (a pool_task)
+It runs the engine on each node of the chunk (from start:end inclusive, or order[start]:order[end] by_component)
+The results are stored as it goes into row i of d (or handed to the result file with -o)
+This is okay, however since no threads have overlapping writes, as each chunk is handed to exactly one thread
+Meaning, all threads can change dist as they progress, the only lock is the short one in dm_store_row
+that lets the matrix widen under them
+The graph is also shared between all threads, but it is only read, so no worries there either
+*/
+void dijkstra_some(void *job, int worker, int start, int end);
+
+/*
+Multi-source BFS (MS-BFS): up to MSBFS_BATCH sources are traversed at once
+Every node keeps a bitset with one bit per source, so one pass over the edges advances all of them a level
+Only valid for unit weight graphs, where the BFS level is the shortest path length
+The levels go straight into d at its width (no int rows in between), widening if the graph is that deep
+*/
+void msbfs_rows(const struct csr_graph *g, int lo, int hi, struct dist_matrix *d, struct sssp_scratch *s);
+
+#endif
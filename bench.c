@@ -0,0 +1,240 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "apsp.h"
+#include "bench.h"
+#include "resultfile.h"
+#include "sssp.h"
+
+int bench_init(struct bench *b, const char *program, const struct run_config *cfg) {
+    memset(b, 0, sizeof(*b));
+    b->program = program;
+    b->warmup = cfg->warmup;
+    b->reps = cfg->reps;
+    b->threads = 1;
+    b->ranks = 1;
+    b->wrong = -1;
+    b->seconds = malloc(b->reps * sizeof(double));
+    if (b->seconds == NULL) {
+        printf("BENCH_INIT: out of memory for %d runs\n", b->reps);
+        return -1;
+    }
+    return 0;
+}
+
+void bench_free(struct bench *b) {
+    free(b->seconds);
+    b->seconds = NULL;
+}
+
+void bench_add(struct bench *b, double seconds) {
+    if (b->runs >= b->warmup && b->runs - b->warmup < b->reps)
+        b->seconds[b->runs - b->warmup] = seconds;
+    b->runs++;
+}
+
+static int by_value(const void *a, const void *b) {
+    double x = *(const double *) a, y = *(const double *) b;
+    return (x > y) - (x < y);
+}
+
+void bench_report(struct bench *b) {
+    int count = b->runs - b->warmup < b->reps ? b->runs - b->warmup : b->reps;
+    if (count <= 0)
+        return;
+    double *sorted = malloc(count * sizeof(double));
+    if (sorted == NULL)
+        return;
+    memcpy(sorted, b->seconds, count * sizeof(double));
+    qsort(sorted, count, sizeof(double), by_value);
+    double sum = 0;
+    for (int i=0; i < count; i++)
+        sum += sorted[i];
+    b->min = sorted[0];
+    b->max = sorted[count - 1];
+    b->mean = sum / count;
+    // Even counts take the mean of the middle two
+    b->median = (sorted[(count - 1) / 2] + sorted[count / 2]) / 2;
+    free(sorted);
+    printf("All pairs time: min %f s, median %f s, mean %f s, max %f s over %d run(s) after %d warmup\n",
+           b->min, b->median, b->mean, b->max, count, b->warmup);
+}
+
+enum engine bench_reference(const struct csr_graph *g, enum engine e) {
+    if (e != ENGINE_HEAP)
+        return ENGINE_HEAP;
+    if (csr_max_weight(g) <= DIAL_MAX_WEIGHT)
+        return ENGINE_DIAL;
+    if (g->n <= FW_MAX_NODES)
+        return ENGINE_DENSE;
+    return ENGINE_AUTO;
+}
+
+void bench_check_report(const struct csr_graph *g, enum engine e, long long wrong) {
+    enum engine ref = bench_reference(g, e);
+    if (ref == ENGINE_AUTO)
+        printf("Check skipped: the heap engine is the reference, and neither dial nor dense fits this graph\n");
+    else if (wrong >= 0)
+        printf("Check against serial %s: %lld entries differ\n",
+               ref == ENGINE_HEAP ? "dijkstra_heap" : ref == ENGINE_DIAL ? "dijkstra_dial" : "dijkstra_one", wrong);
+}
+
+// The reference kernel of one check, and what it needs
+struct reference {
+    const struct csr_graph *g;
+    enum engine kernel; // ENGINE_HEAP, ENGINE_DIAL or ENGINE_DENSE (see bench_reference)
+    int max_weight;
+    struct dense_adj dense;
+    struct sssp_scratch *s;
+    int *row;
+};
+
+// Returns 0 on success, -1 when there is no reference for e or no memory for it
+static int reference_init(struct reference *r, const struct csr_graph *g, enum engine e) {
+    r->g = g;
+    r->kernel = bench_reference(g, e);
+    r->max_weight = csr_max_weight(g);
+    r->dense.bits = NULL;
+    r->dense.w = NULL;
+    r->s = NULL;
+    r->row = NULL;
+    if (r->kernel == ENGINE_AUTO)
+        return -1;
+    r->s = scratch_create(g->n);
+    r->row = malloc(g->n * sizeof(int));
+    if (r->s == NULL || r->row == NULL || (r->kernel == ENGINE_DENSE && dense_adj_build(&r->dense, g)) ||
+        scratch_reserve(r->s, r->dense.bits ? r->dense.words : 0, r->kernel == ENGINE_DIAL ? r->max_weight : 0, false, false)) {
+        printf("BENCH_CHECK: out of memory for %d nodes\n", g->n);
+        exit(-1);
+    }
+    return 0;
+}
+
+static void reference_free(struct reference *r) {
+    dense_adj_free(&r->dense);
+    scratch_free(r->s);
+    free(r->row);
+}
+
+// Row src of the reference into r->row
+static void reference_row(struct reference *r, int src) {
+    if (r->kernel == ENGINE_DIAL)
+        dijkstra_dial(r->g, r->max_weight, src, r->row, r->s, NULL);
+    else if (r->kernel == ENGINE_DENSE)
+        dijkstra_one(&r->dense, src, 0, r->row, r->s);
+    else
+        dijkstra_heap(r->g, src, r->row, r->s, NULL);
+}
+
+long long bench_check(const struct csr_graph *g, enum engine e, const struct dist_matrix *d) {
+    struct reference ref;
+    if (reference_init(&ref, g, e))
+        return -1;
+    long long wrong = 0;
+    for (int r=d->first; r < d->first + d->rows; r++) {
+        reference_row(&ref, r);
+        for (int c=0; c < g->n; c++)
+            wrong += dm_get(d, r, c) != ref.row[c];
+    }
+    reference_free(&ref);
+    return wrong;
+}
+
+long long bench_check_file(const struct csr_graph *g, enum engine e, const char *path) {
+    struct reference ref;
+    if (reference_init(&ref, g, e))
+        return -1;
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        printf("BENCH_CHECK_FILE: could not open %s\n", path);
+        reference_free(&ref);
+        return -1;
+    }
+    struct result_file_header h;
+    if (fread(&h, sizeof(h), 1, f) != 1 || memcmp(h.magic, RESULT_FILE_MAGIC, 8) != 0 ||
+        h.n != g->n || fseek(f, RESULT_FILE_HEADER, SEEK_SET)) {
+        printf("BENCH_CHECK_FILE: %s is not a result file for %d nodes\n", path, g->n);
+        reference_free(&ref);
+        fclose(f);
+        return -1;
+    }
+    // Read back a row at a time into a one row dist_matrix, then it is the same check as bench_check
+    struct dist_matrix row;
+    if (dm_init_width(&row, 0, 1, g->n, h.width)) {
+        reference_free(&ref);
+        fclose(f);
+        return -1;
+    }
+    long long wrong = 0;
+    for (int r=0; r < g->n && wrong >= 0; r++) {
+        if (fread(row.data, h.width, g->n, f) != (size_t)g->n) {
+            printf("BENCH_CHECK_FILE: %s ends at row %d\n", path, r);
+            wrong = -1;
+            break;
+        }
+        reference_row(&ref, r);
+        for (int c=0; c < g->n; c++)
+            wrong += dm_get(&row, 0, c) != ref.row[c];
+    }
+    reference_free(&ref);
+    dm_free(&row);
+    fclose(f);
+    return wrong;
+}
+
+int bench_record(const char *path, const struct bench *b, const struct run_config *cfg, const struct csr_graph *g) {
+    FILE *f = fopen(path, "a");
+    if (f == NULL) {
+        printf("BENCH_RECORD: could not open %s\n", path);
+        return -1;
+    }
+    const char *graph = cfg->file ? cfg->file : gen_name(cfg->gen);
+    const char *check = b->wrong < 0 ? "off" : b->wrong == 0 ? "pass" : "fail";
+    size_t len = strlen(path);
+    bool json = len >= 5 && strcmp(path + len - 5, ".json") == 0;
+    long long stamp = (long long) time(NULL);
+    // -W for generated graphs, the heaviest edge for files (where -W does nothing)
+    int max_weight = cfg->file ? csr_max_weight(g) : cfg->max_weight;
+    if (json) {
+        fprintf(f, "{\"time\": %lld, \"program\": \"%s\", \"graph\": \"%s\", \"n\": %d, \"nnz\": %lld, \"split\": %d, \"seed\": %u, "
+                   "\"max_weight\": %d, \"engine\": \"%s\", \"threads\": %d, \"ranks\": %d, \"chunk\": %d, \"collect\": \"%s\", "
+                   "\"place\": \"%s\", \"components\": %s, \"width\": %d, "
+                   "\"warmup\": %d, \"reps\": %d, \"min\": %f, \"median\": %f, \"mean\": %f, \"max\": %f, "
+                   "\"check\": \"%s\", \"wrong\": %lld}\n",
+                stamp, b->program, graph, g->n, (long long)g->nnz, cfg->split, cfg->seed,
+                max_weight, b->engine, b->threads, b->ranks, cfg->chunk, collect_name(cfg->collect),
+                place_name(cfg->place), cfg->components ? "true" : "false", b->width,
+                b->warmup, b->reps, b->min, b->median, b->mean, b->max, check, b->wrong);
+    } else {
+        // Appending, so the file is empty (and needs its header) exactly when it starts at 0
+        // A file started with other columns is left alone, rather than mixing rows of two layouts
+        static const char *header = "time,program,graph,n,nnz,split,seed,max_weight,engine,threads,ranks,chunk,collect,"
+                                    "place,components,width,warmup,reps,min,median,mean,max,check,wrong\n";
+        fseek(f, 0, SEEK_END);
+        if (ftell(f) == 0) {
+            fputs(header, f);
+        } else {
+            char first[256];
+            FILE *r = fopen(path, "r");
+            bool same = r != NULL && fgets(first, sizeof(first), r) != NULL && strcmp(first, header) == 0;
+            if (r != NULL)
+                fclose(r);
+            if (!same) {
+                printf("BENCH_RECORD: %s has different columns, start a new file\n", path);
+                fclose(f);
+                return -1;
+            }
+        }
+        fprintf(f, "%lld,%s,%s,%d,%lld,%d,%u,%d,%s,%d,%d,%d,%s,%s,%s,%d,%d,%d,%f,%f,%f,%f,%s,%lld\n",
+                stamp, b->program, graph, g->n, (long long)g->nnz, cfg->split, cfg->seed,
+                max_weight, b->engine, b->threads, b->ranks, cfg->chunk, collect_name(cfg->collect),
+                place_name(cfg->place), cfg->components ? "on" : "off", b->width,
+                b->warmup, b->reps, b->min, b->median, b->mean, b->max, check, b->wrong);
+    }
+    if (fclose(f)) {
+        printf("BENCH_RECORD: could not write %s\n", path);
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,68 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include "config.h"
+#include "distmat.h"
+#include "graph.h"
+
+/*
+Timings of the repeated all pairs runs of one program (-w warmup, -r runs), and what to record about them
+The warmup runs are timed too but thrown away: they pay for page faults, first touch of dist and the caches
+Every program times wall clock (timing.h, or MPI_Wtime in loose), never clock(), which adds up every thread
+*/
+struct bench {
+    const char *program; // serial, tight or loose
+    int warmup;
+    int reps;
+    int runs; // runs added so far, warmup included
+    double *seconds; // the timed runs
+    double min, median, mean, max; // of seconds, filled in by bench_report
+    // Filled in by the program before bench_record
+    const char *engine;
+    int threads;
+    int ranks;
+    int width; // bytes per dist entry
+    long long wrong; // entries that differ from the reference, -1 when not checked
+};
+
+// Returns 0 on success
+int bench_init(struct bench *b, const char *program, const struct run_config *cfg);
+void bench_free(struct bench *b);
+
+// Adds the time of the next run (ignored while still warming up)
+void bench_add(struct bench *b, double seconds);
+
+// Works out min/median/mean/max of the timed runs and prints them on one line
+void bench_report(struct bench *b);
+
+/*
+The kernel bench_check holds engine e's rows to, which is never e's own: dijkstra_heap for every engine but heap,
+and for heap dijkstra_dial (weights up to DIAL_MAX_WEIGHT) or else the dense dijkstra_one (n up to FW_MAX_NODES)
+ENGINE_AUTO when none of them fits, and there is nothing independent to check the heap engine against
+*/
+enum engine bench_reference(const struct csr_graph *g, enum engine e);
+
+/*
+Checks every row d holds (computed with engine e) against bench_reference's kernel on g
+One row at a time, so it needs O(V) memory on top of d (O(V^2) for the dense one, which only runs up to FW_MAX_NODES)
+Returns the number of entries that differ, -1 when there is no reference
+*/
+long long bench_check(const struct csr_graph *g, enum engine e, const struct dist_matrix *d);
+
+// Same as bench_check for a result file written with -o, -1 if it can't be read
+long long bench_check_file(const struct csr_graph *g, enum engine e, const char *path);
+
+// Prints the outcome of a check of engine e's rows, or that it was skipped
+void bench_check_report(const struct csr_graph *g, enum engine e, long long wrong);
+
+/*
+Appends one record of b (and the run's config) to path, to track runs over time or plot a sweep
+path ending in .json gets one JSON object per line, anything else CSV, with a header when the file is new
+(and nothing appended to a CSV whose header has other columns)
+Every option that changes the result or the timing is a column: size, weights, engine, threads, chunking, collect,
+placement and components
+Returns 0 on success
+*/
+int bench_record(const char *path, const struct bench *b, const struct run_config *cfg, const struct csr_graph *g);
+
+#endif
@@ -0,0 +1,192 @@
+#define _POSIX_C_SOURCE 200809L // getopt
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "config.h"
+
+static void usage(const char *prog) {
+    printf("Usage: %s [-n nodes] [-d split] [-s seed] [-G legacy|er|rmat|grid] [-W max weight] [-e auto|dense|heap|bfs|fw|dial] [-p] [-t threads] [-c chunk] [-g gather|stream|none] [-f graph file] [-o result file] [-q queries] [-u updates] [-w warmup runs] [-r timed runs] [-k] [-b bench file] [-S] [-P none|compact|spread] [-L landmarks] [-l degree|farthest] [-x]\n", prog);
+}
+
+const char *engine_name(enum engine e) {
+    switch (e) {
+        case ENGINE_AUTO: return "auto";
+        case ENGINE_DENSE: return "dense";
+        case ENGINE_HEAP: return "heap";
+        case ENGINE_BFS: return "bfs";
+        case ENGINE_FW: return "fw";
+        case ENGINE_DIAL: return "dial";
+    }
+    return "unknown";
+}
+
+const char *collect_name(enum collect c) {
+    switch (c) {
+        case COLLECT_GATHER: return "gather";
+        case COLLECT_STREAM: return "stream";
+        case COLLECT_NONE: return "none";
+    }
+    return "unknown";
+}
+
+const char *gen_name(enum generator g) {
+    switch (g) {
+        case GEN_LEGACY: return "legacy";
+        case GEN_ER: return "er";
+        case GEN_RMAT: return "rmat";
+        case GEN_GRID: return "grid";
+    }
+    return "unknown";
+}
+
+const char *place_name(enum placement p) {
+    switch (p) {
+        case PLACE_NONE: return "none";
+        case PLACE_COMPACT: return "compact";
+        case PLACE_SPREAD: return "spread";
+    }
+    return "unknown";
+}
+
+const char *select_name(enum landmark_select s) {
+    switch (s) {
+        case LANDMARK_DEGREE: return "degree";
+        case LANDMARK_FARTHEST: return "farthest";
+    }
+    return "unknown";
+}
+
+// Reverse of engine_name, returns -1 for a name that is not an engine
+static int engine_from_name(const char *name) {
+    for (int e=0; e <= ENGINE_LAST; e++)
+        if (strcmp(name, engine_name((enum engine)e)) == 0)
+            return e;
+    return -1;
+}
+
+// Reverse of gen_name, returns -1 for a name that is not a generator
+static int gen_from_name(const char *name) {
+    for (int g=0; g <= GEN_LAST; g++)
+        if (strcmp(name, gen_name((enum generator)g)) == 0)
+            return g;
+    return -1;
+}
+
+int parse_args(int argc, char *argv[], struct run_config *cfg) {
+    // Defaults match what the programs used to be compiled with
+    cfg->n = 1000;
+    cfg->split = 5;
+    cfg->seed = 0;
+    cfg->gen = GEN_LEGACY;
+    cfg->max_weight = 1;
+    cfg->engine = ENGINE_AUTO;
+    cfg->print = false;
+    cfg->threads = 0;
+    cfg->chunk = 0;
+    cfg->collect = COLLECT_GATHER;
+    cfg->file = NULL;
+    cfg->out = NULL;
+    cfg->queries = 0;
+    cfg->updates = 0;
+    cfg->warmup = 0;
+    cfg->reps = 1;
+    cfg->check = false;
+    cfg->bench = NULL;
+    cfg->components = true;
+    cfg->place = PLACE_NONE;
+    cfg->landmarks = 0;
+    cfg->select = LANDMARK_DEGREE;
+    cfg->refine = false;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:d:s:G:W:e:pt:c:g:f:o:q:u:w:r:kb:SP:L:l:x")) != -1) {
+        switch (opt) {
+            case 'n': cfg->n = atoi(optarg); break;
+            case 'd': cfg->split = atoi(optarg); break;
+            case 's': cfg->seed = (unsigned int)strtoul(optarg, NULL, 10); break;
+            case 'G':
+                if (gen_from_name(optarg) < 0) {
+                    printf("Unknown generator: %s\n", optarg);
+                    usage(argv[0]);
+                    return -1;
+                }
+                cfg->gen = (enum generator)gen_from_name(optarg);
+                break;
+            case 'W': cfg->max_weight = atoi(optarg); break;
+            case 'e':
+                if (engine_from_name(optarg) < 0) {
+                    printf("Unknown engine: %s\n", optarg);
+                    usage(argv[0]);
+                    return -1;
+                }
+                cfg->engine = (enum engine)engine_from_name(optarg);
+                break;
+            case 'p': cfg->print = true; break;
+            case 't': cfg->threads = atoi(optarg); break;
+            case 'c': cfg->chunk = atoi(optarg); break;
+            case 'g':
+                if (strcmp(optarg, "gather") == 0)
+                    cfg->collect = COLLECT_GATHER;
+                else if (strcmp(optarg, "stream") == 0)
+                    cfg->collect = COLLECT_STREAM;
+                else if (strcmp(optarg, "none") == 0)
+                    cfg->collect = COLLECT_NONE;
+                else {
+                    printf("Unknown collect mode: %s\n", optarg);
+                    usage(argv[0]);
+                    return -1;
+                }
+                break;
+            case 'f': cfg->file = optarg; break;
+            case 'o': cfg->out = optarg; break;
+            case 'q': cfg->queries = atoi(optarg); break;
+            case 'u': cfg->updates = atoi(optarg); break;
+            case 'w': cfg->warmup = atoi(optarg); break;
+            case 'r': cfg->reps = atoi(optarg); break;
+            case 'k': cfg->check = true; break;
+            case 'b': cfg->bench = optarg; break;
+            case 'S': cfg->components = false; break;
+            case 'P':
+                if (strcmp(optarg, "none") == 0)
+                    cfg->place = PLACE_NONE;
+                else if (strcmp(optarg, "compact") == 0)
+                    cfg->place = PLACE_COMPACT;
+                else if (strcmp(optarg, "spread") == 0)
+                    cfg->place = PLACE_SPREAD;
+                else {
+                    printf("Unknown placement: %s\n", optarg);
+                    usage(argv[0]);
+                    return -1;
+                }
+                break;
+            case 'L': cfg->landmarks = atoi(optarg); break;
+            case 'l':
+                if (strcmp(optarg, "degree") == 0)
+                    cfg->select = LANDMARK_DEGREE;
+                else if (strcmp(optarg, "farthest") == 0)
+                    cfg->select = LANDMARK_FARTHEST;
+                else {
+                    printf("Unknown landmark selection: %s\n", optarg);
+                    usage(argv[0]);
+                    return -1;
+                }
+                break;
+            case 'x': cfg->refine = true; break;
+            default:
+                usage(argv[0]);
+                return -1;
+        }
+    }
+
+    if (cfg->n <= 0 || cfg->split < 0 || cfg->split > 100 || cfg->max_weight < 1 || cfg->threads < 0 || cfg->chunk < 0 || cfg->queries < 0 || cfg->updates < 0 ||
+        cfg->warmup < 0 || cfg->reps < 1 || cfg->landmarks < 0) {
+        printf("Need nodes > 0, 0 <= split <= 100, weight >= 1, threads >= 0, chunk >= 0, queries >= 0, updates >= 0, warmup >= 0, runs >= 1 and landmarks >= 0\n");
+        usage(argv[0]);
+        return -1;
+    }
+    // Same rule the programs always had: printing large matrices is useless and ruins the timing
+    if (cfg->n <= 100)
+        cfg->print = true;
+    return 0;
+}
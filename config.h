@@ -0,0 +1,107 @@
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#include <stdbool.h>
+
+// Which single source kernel computes the rows of dist
+enum engine {
+    ENGINE_AUTO, // pick from the graph, see engine_select
+    ENGINE_DENSE, // original O(V^2) dijkstra_one, on a transposed (bit-packed for 0/1 graphs) adjacency
+    ENGINE_HEAP, // dijkstra_heap on the CSR graph
+    ENGINE_BFS, // bit-parallel multi-source BFS, unit weight graphs only
+    ENGINE_FW, // blocked Floyd-Warshall, whole matrix at once (serial and tight only)
+    ENGINE_DIAL // bucket queue dijkstra on the CSR graph, small integer weights
+};
+#define ENGINE_LAST ENGINE_DIAL
+
+// How loose returns every process's rows to processor 0
+enum collect {
+    COLLECT_GATHER, // one MPI_Gatherv of exactly the rows each process owns
+    COLLECT_STREAM, // non-blocking sends of each finished chunk while the next one is computed
+    COLLECT_NONE // leave the rows where they were computed (for results too big for one node)
+};
+
+// Where the pool threads (and loose's processors) run, and so which NUMA node their memory lands on (see place.h)
+enum placement {
+    PLACE_NONE, // threads float wherever the scheduler puts them
+    PLACE_COMPACT, // one core each, filling a NUMA node before moving to the next
+    PLACE_SPREAD // one core each, dealt round robin over the NUMA nodes
+};
+
+// How the landmarks of the distance oracle are picked (see oracle.h)
+enum landmark_select {
+    LANDMARK_DEGREE, // the nodes with the most edges in and out
+    LANDMARK_FARTHEST // each one as far as possible from the ones already picked
+};
+
+// How the graph is made when there is no -f (see gen.h)
+enum generator {
+    GEN_LEGACY, // the original rand() graph, O(V^2)
+    GEN_ER, // Erdos-Renyi by geometric skipping, O(E)
+    GEN_RMAT, // skewed degrees, R-MAT
+    GEN_GRID // 2D grid
+};
+#define GEN_LAST GEN_GRID
+
+/*
+Everything that used to be a #define at the top of each program
+Filled in by parse_args from the command line so one build can be swept across sizes:
+    -n nodes   number of nodes in the graph (default 1000)
+    -d split   % chance of any given connection existing (default 5)
+    -s seed    seed for the generator (default 0, same graph the original programs made)
+    -G gen     legacy | er | rmat | grid, how the graph is generated (default legacy, see gen.h)
+    -W weight  give every generated edge a weight in 1:weight (default 1 = unweighted)
+    -e engine  auto | dense | heap | bfs | fw | dial (default auto, see engine_select)
+    -p         print M and dist (only done automatically when nodes <= 100)
+    -t threads number of worker threads (default 0 = one per CPU online)
+    -c chunk   sources per chunk of work handed to a thread (default 0 = pick from the engine)
+    -g collect gather | stream | none, how loose collects the rows (default gather)
+    -f file    read the graph from file instead of generating it (see graphio.h), -n/-d/-s/-G/-W are ignored
+    -o file    stream dist to file as rows finish instead of keeping it in memory (see resultfile.h)
+    -q pairs   tight only: answer this many random point to point queries instead of all pairs (see query.h)
+    -u edges   serial only: after all pairs, apply this many random edge updates incrementally (see incremental.h)
+    -w runs    untimed warmup runs of the all pairs computation before the timed ones (default 0)
+    -r runs    timed runs of the all pairs computation (default 1), reported as min/median/mean/max
+    -k         check dist against the serial heap dijkstra reference after the last run (see bench.h)
+    -b file    append one record of the runs to file, JSON lines if it ends in .json, CSV otherwise
+    -S         don't split the graph into strongly connected components first (see apsp_input_components)
+    -P place   none | compact | spread, pin the threads to cores and their dist rows to their NUMA node (default none)
+    -L k       tight only: build a distance oracle on k landmarks instead of all pairs, and answer -q queries with it (see oracle.h)
+    -l select  degree | farthest, how the landmarks are picked (default degree)
+    -x         answer the oracle's queries exactly, with a search bounded by the landmark estimate
+*/
+struct run_config {
+    int n;
+    int split;
+    unsigned int seed;
+    enum generator gen;
+    int max_weight;
+    enum engine engine;
+    bool print;
+    int threads;
+    int chunk;
+    enum collect collect;
+    const char *file; // NULL = generate
+    const char *out; // NULL = dist stays in memory
+    int queries; // 0 = all pairs
+    int updates; // 0 = no update batch
+    int warmup;
+    int reps;
+    bool check;
+    const char *bench; // NULL = no record
+    bool components;
+    enum placement place;
+    int landmarks; // 0 = no oracle
+    enum landmark_select select;
+    bool refine;
+};
+
+// Returns 0 on success, prints usage and returns -1 on bad arguments
+int parse_args(int argc, char *argv[], struct run_config *cfg);
+const char *engine_name(enum engine e);
+const char *collect_name(enum collect c);
+const char *gen_name(enum generator g);
+const char *place_name(enum placement p);
+const char *select_name(enum landmark_select s);
+
+#endif
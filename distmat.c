@@ -0,0 +1,180 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "distmat.h"
+#include "place.h"
+
+int dm_init(struct dist_matrix *d, int first, int rows, int n) {
+    return dm_init_width(d, first, rows, n, 1);
+}
+
+int dm_init_width(struct dist_matrix *d, int first, int rows, int n, int width) {
+    d->n = n;
+    d->first = first;
+    d->rows = rows;
+    d->width = width;
+    d->data = malloc((size_t)(rows > 0 ? rows : 1) * n * width);
+    if (d->data == NULL) {
+        printf("DM_INIT: not enough memory for %d x %d distances\n", rows, n);
+        return -1;
+    }
+    pthread_mutex_init(&d->lock, NULL);
+    pthread_cond_init(&d->changed, NULL);
+    d->storing = 0;
+    d->widening = false;
+    d->keep_old = false;
+    d->nretired = 0;
+    d->place = NULL;
+    d->row_node = NULL;
+    return 0;
+}
+
+void dm_free(struct dist_matrix *d) {
+    free(d->data);
+    d->data = NULL;
+    for (int i=0; i < d->nretired; i++)
+        free(d->retired[i]);
+    d->nretired = 0;
+    pthread_mutex_destroy(&d->lock);
+    pthread_cond_destroy(&d->changed);
+}
+
+void dm_place(struct dist_matrix *d, const struct place_plan *plan, const int *row_node) {
+    d->place = plan;
+    d->row_node = row_node;
+    if (place_rows(plan, d->data, d->rows, (size_t)d->n * d->width, row_node))
+        printf("DM_PLACE: no NUMA policy support, rows go wherever they are first stored\n");
+}
+
+// Copies count entries of width from to width to (to >= from), keeping the sentinel a sentinel
+static void widen_entries(void *dst, int to, const void *src, int from, size_t count) {
+    if (from == 1 && to == 2) {
+        const uint8_t *s = src;
+        uint16_t *o = dst;
+        for (size_t i=0; i < count; i++)
+            o[i] = s[i] == UINT8_MAX ? UINT16_MAX : s[i];
+    } else if (from == 1) {
+        const uint8_t *s = src;
+        int *o = dst;
+        for (size_t i=0; i < count; i++)
+            o[i] = s[i] == UINT8_MAX ? NC : s[i];
+    } else if (from == 2 && to == 4) {
+        const uint16_t *s = src;
+        int *o = dst;
+        for (size_t i=0; i < count; i++)
+            o[i] = s[i] == UINT16_MAX ? NC : s[i];
+    }
+}
+
+void dm_widen(struct dist_matrix *d, int width) {
+    pthread_mutex_lock(&d->lock);
+    // Someone else may be widening already, and may get there first
+    while (d->widening)
+        pthread_cond_wait(&d->changed, &d->lock);
+    if (width <= d->width) {
+        pthread_mutex_unlock(&d->lock);
+        return;
+    }
+    d->widening = true;
+    while (d->storing > 0)
+        pthread_cond_wait(&d->changed, &d->lock);
+    pthread_mutex_unlock(&d->lock);
+
+    // Nobody can store until widening is cleared, so the data is all ours
+    size_t count = (size_t)(d->rows > 0 ? d->rows : 1) * d->n;
+    void *wide = malloc(count * width);
+    if (wide == NULL) {
+        printf("DM_WIDEN: not enough memory for %d byte distances\n", width);
+        exit(-1);
+    }
+    // Converting here would fault every page in on this thread's node, so the rows are placed first
+    place_rows(d->place, wide, d->rows, (size_t)d->n * width, d->row_node);
+    widen_entries(wide, width, d->data, d->width, count);
+    if (d->keep_old)
+        d->retired[d->nretired++] = d->data;
+    else
+        free(d->data);
+
+    pthread_mutex_lock(&d->lock);
+    d->data = wide;
+    d->width = width;
+    d->widening = false;
+    pthread_cond_broadcast(&d->changed);
+    pthread_mutex_unlock(&d->lock);
+}
+
+void dm_begin_store(struct dist_matrix *d, int largest) {
+    int need = dm_width_for(largest);
+    pthread_mutex_lock(&d->lock);
+    for (;;) {
+        while (d->widening)
+            pthread_cond_wait(&d->changed, &d->lock);
+        if (need <= d->width)
+            break;
+        pthread_mutex_unlock(&d->lock);
+        dm_widen(d, need);
+        pthread_mutex_lock(&d->lock);
+    }
+    d->storing++;
+    pthread_mutex_unlock(&d->lock);
+}
+
+void dm_end_store(struct dist_matrix *d) {
+    pthread_mutex_lock(&d->lock);
+    if (--d->storing == 0 && d->widening)
+        pthread_cond_broadcast(&d->changed);
+    pthread_mutex_unlock(&d->lock);
+}
+
+void dm_store_row(struct dist_matrix *d, int r, const int *vals) {
+    int n = d->n;
+    int largest = 0;
+    for (int c=0; c < n; c++)
+        if (vals[c] != NC && vals[c] > largest)
+            largest = vals[c];
+
+    dm_begin_store(d, largest);
+    // One loop per width so each one is a plain (vectorizable) narrowing copy
+    void *row = dm_row(d, r);
+    if (d->width == 1) {
+        uint8_t *o = row;
+        for (int c=0; c < n; c++)
+            o[c] = vals[c] == NC ? UINT8_MAX : (uint8_t) vals[c];
+    } else if (d->width == 2) {
+        uint16_t *o = row;
+        for (int c=0; c < n; c++)
+            o[c] = vals[c] == NC ? UINT16_MAX : (uint16_t) vals[c];
+    } else {
+        int *o = row;
+        for (int c=0; c < n; c++)
+            o[c] = vals[c];
+    }
+    dm_end_store(d);
+}
+
+void dm_store_packed(struct dist_matrix *d, int r, int count, const void *src, int src_width) {
+    dm_widen(d, src_width);
+    size_t entries = (size_t)count * d->n;
+    if (src_width == d->width) {
+        memcpy(dm_row(d, r), src, entries * src_width);
+    } else {
+        widen_entries(dm_row(d, r), d->width, src, src_width, entries);
+    }
+}
+
+void dm_get_row(const struct dist_matrix *d, int r, int *out) {
+    for (int c=0; c < d->n; c++)
+        out[c] = dm_get(d, r, c);
+}
+
+void dm_print(const struct dist_matrix *d) {
+    int *row = malloc(d->n * sizeof(int));
+    if (row == NULL)
+        return;
+    for (int r=d->first; r < d->first + d->rows; r++) {
+        dm_get_row(d, r, row);
+        print_row(row, d->n);
+    }
+    printf("\n");
+    free(row);
+}
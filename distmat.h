@@ -0,0 +1,121 @@
+#ifndef DISTMAT_H
+#define DISTMAT_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "graph.h"
+
+struct place_plan;
+
+/*
+The all pairs result, stored with the narrowest entry that can hold it
+For the hop count graphs the generator makes the diameter is tiny, so a byte per entry is plenty
+and the matrix is a quarter the size of int dist[n][n] (same for the bandwidth of every write and MPI transfer)
+    width 1: uint8_t,  finite distances 0:254,   255 = no connection
+    width 2: uint16_t, finite distances 0:65534, 65535 = no connection
+    width 4: int,      finite distances 0:NC-1,  NC = no connection (same as the kernels)
+A matrix starts at width 1 and widens (every entry is converted) the first time a store does not fit
+It can hold only some of the rows: data row 0 is row first of the whole matrix, so loose keeps just its own
+*/
+struct dist_matrix {
+    int n; // columns (nodes in the graph)
+    int first; // row of the whole matrix that data row 0 holds
+    int rows; // rows held
+    int width; // bytes per entry: 1, 2 or 4
+    void *data;
+
+    // Stores run in parallel, widening waits until none are in progress (and blocks new ones)
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    int storing; // threads between dm_begin_store and dm_end_store
+    bool widening;
+    // When set, widening keeps the old data around (until dm_free) instead of freeing it,
+    // for loose's streamed sends, which read rows straight out of data while the threads keep working
+    bool keep_old;
+    void *retired[2];
+    int nretired;
+    // When set (see dm_place), the NUMA node every held row goes on, reapplied whenever widening reallocates
+    const struct place_plan *place;
+    const int *row_node;
+};
+
+// Sets up rows first:first+rows-1 of an n column matrix at width 1. Returns 0 on success
+int dm_init(struct dist_matrix *d, int first, int rows, int n);
+// Same, but starting at width (for a matrix that has to match something already that wide)
+int dm_init_width(struct dist_matrix *d, int first, int rows, int n, int width);
+void dm_free(struct dist_matrix *d);
+
+/*
+Puts data row i (row first+i) on the NUMA node of row_node[i] before anything is stored (see place_rows),
+and again on the new data every time the matrix widens. row_node must live as long as d
+*/
+void dm_place(struct dist_matrix *d, const struct place_plan *plan, const int *row_node);
+
+// Largest finite distance an entry of this width can hold
+static inline int dm_max(int width) {
+    return width == 1 ? UINT8_MAX - 1 : width == 2 ? UINT16_MAX - 1 : NC - 1;
+}
+
+// Narrowest width that holds the distance v
+static inline int dm_width_for(int v) {
+    return v <= dm_max(1) ? 1 : v <= dm_max(2) ? 2 : 4;
+}
+
+/*
+Converts every entry to width (a no-op if the matrix is already at least that wide)
+Must not be called between dm_begin_store and dm_end_store, it waits for every store to finish
+*/
+void dm_widen(struct dist_matrix *d, int width);
+
+/*
+Bracket a batch of dm_set calls. The width can't change in between
+largest is the biggest finite value about to be stored, the matrix is widened first if it needs to be
+*/
+void dm_begin_store(struct dist_matrix *d, int largest);
+void dm_end_store(struct dist_matrix *d);
+
+// Pointer to the start of (whole matrix) row r
+static inline void *dm_row(const struct dist_matrix *d, int r) {
+    return (char *) d->data + ((size_t)(r - d->first) * d->n) * d->width;
+}
+
+// Entry [r][c] = v, v is a distance or NC. Only valid between dm_begin_store and dm_end_store
+static inline void dm_set(struct dist_matrix *d, int r, int c, int v) {
+    void *row = dm_row(d, r);
+    switch (d->width) {
+        case 1: ((uint8_t *) row)[c] = v == NC ? UINT8_MAX : (uint8_t) v; break;
+        case 2: ((uint16_t *) row)[c] = v == NC ? UINT16_MAX : (uint16_t) v; break;
+        default: ((int *) row)[c] = v; break;
+    }
+}
+
+// Entry [r][c], NC when there is no connection
+static inline int dm_get(const struct dist_matrix *d, int r, int c) {
+    const void *row = dm_row(d, r);
+    switch (d->width) {
+        case 1: { uint8_t v = ((const uint8_t *) row)[c]; return v == UINT8_MAX ? NC : v; }
+        case 2: { uint16_t v = ((const uint16_t *) row)[c]; return v == UINT16_MAX ? NC : v; }
+        default: return ((const int *) row)[c];
+    }
+}
+
+/*
+Stores the int row vals (as the kernels produce it, NC for no connection) as row r, widening if needed
+Safe to call from many threads at once, as long as they store different rows
+*/
+void dm_store_row(struct dist_matrix *d, int r, const int *vals);
+
+/*
+Stores count rows starting at row r, given at src_width (rows received from another process)
+Not thread safe, but widens as needed like dm_store_row
+*/
+void dm_store_packed(struct dist_matrix *d, int r, int count, const void *src, int src_width);
+
+// Copies row r out as ints (NC for no connection)
+void dm_get_row(const struct dist_matrix *d, int r, int *out);
+
+// Prints every row held, same format as print_m
+void dm_print(const struct dist_matrix *d);
+
+#endif
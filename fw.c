@@ -0,0 +1,192 @@
+#define _POSIX_C_SOURCE 200809L // posix_memalign, pthread_barrier
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "fw.h"
+#include "instrument.h"
+#if defined(__AVX512F__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+// Everything the phase workers share
+struct fw_shared {
+    int *d; // padded N*N matrix being relaxed
+    int N; // padded size, a multiple of FW_BLOCK
+    int nb; // number of tiles per row/column
+    int nthreads;
+    pthread_barrier_t barrier;
+};
+
+struct fw_thread {
+    int tid;
+    struct fw_shared *sh;
+};
+
+static inline int *tile(const struct fw_shared *sh, int bi, int bj) {
+    return sh->d + (size_t)bi * FW_BLOCK * sh->N + (size_t)bj * FW_BLOCK;
+}
+
+/*
+c[i][j] = min(c[i][j], a[i][k] + b[k][j]) for the FW_BLOCK k's of one block
+k is the outer loop so this is also correct when c is a or b (phases 1 and 2), as long as
+a[k][k] = 0, which it is since the diagonal of dist is 0
+*/
+static void tile_update(int *c, const int *a, const int *b, int N) {
+    for (int k=0; k < FW_BLOCK; k++) {
+        const int *brow = b + (size_t)k * N;
+        for (int i=0; i < FW_BLOCK; i++) {
+            int aik = a[(size_t)i * N + k];
+            if (aik >= FW_INF)
+                continue; // no path i->k, so nothing in this row can improve
+            int *crow = c + (size_t)i * N;
+#if defined(__AVX512F__)
+            __m512i va = _mm512_set1_epi32(aik);
+            for (int j=0; j < FW_BLOCK; j += 16) {
+                __m512i vb = _mm512_loadu_si512((const void *)(brow + j));
+                __m512i vc = _mm512_loadu_si512((const void *)(crow + j));
+                _mm512_storeu_si512((void *)(crow + j), _mm512_min_epi32(vc, _mm512_add_epi32(va, vb)));
+            }
+#elif defined(__AVX2__)
+            __m256i va = _mm256_set1_epi32(aik);
+            for (int j=0; j < FW_BLOCK; j += 8) {
+                __m256i vb = _mm256_loadu_si256((const __m256i *)(brow + j));
+                __m256i vc = _mm256_loadu_si256((const __m256i *)(crow + j));
+                _mm256_storeu_si256((__m256i *)(crow + j), _mm256_min_epi32(vc, _mm256_add_epi32(va, vb)));
+            }
+#else
+            for (int j=0; j < FW_BLOCK; j++) {
+                int alt = aik + brow[j];
+                crow[j] = alt < crow[j] ? alt : crow[j];
+            }
+#endif
+        }
+    }
+}
+
+/*
+Every thread runs this loop over the k blocks, tiles are handed out round robin by index
+Phase 1 (the diagonal tile) is done by thread 0 alone since everything after depends on it
+*/
+static void *fw_worker(void *arg) {
+    struct fw_thread *me = (struct fw_thread *) arg;
+    struct fw_shared *sh = me->sh;
+    int nb = sh->nb;
+    // Worker 0 is the calling thread, which already has a slot of its own
+    if (me->tid > 0)
+        INSTR_THREAD("fw", me->tid);
+    INSTR_BEGIN(mark, PHASE_COMPUTE);
+    INSTR_LOCAL(tiles);
+
+    for (int kb=0; kb < nb; kb++) {
+        int *diag = tile(sh, kb, kb);
+        if (me->tid == 0) {
+            tile_update(diag, diag, diag, sh->N);
+            INSTR_INC(tiles, 1);
+        }
+        pthread_barrier_wait(&sh->barrier);
+
+        // Phase 2: the nb-1 tiles of block row kb, then the nb-1 tiles of block column kb
+        for (int t=me->tid; t < 2*(nb-1); t += sh->nthreads) {
+            int other = t % (nb-1);
+            if (other >= kb)
+                other++; // skip the diagonal
+            if (t < nb-1) {
+                int *c = tile(sh, kb, other);
+                tile_update(c, diag, c, sh->N);
+            } else {
+                int *c = tile(sh, other, kb);
+                tile_update(c, c, diag, sh->N);
+            }
+            INSTR_INC(tiles, 1);
+        }
+        pthread_barrier_wait(&sh->barrier);
+
+        // Phase 3: every remaining tile only reads the (now final) row and column tiles
+        for (int t=me->tid; t < (nb-1)*(nb-1); t += sh->nthreads) {
+            int bi = t / (nb-1), bj = t % (nb-1);
+            if (bi >= kb)
+                bi++;
+            if (bj >= kb)
+                bj++;
+            tile_update(tile(sh, bi, bj), tile(sh, bi, kb), tile(sh, kb, bj), sh->N);
+            INSTR_INC(tiles, 1);
+        }
+        pthread_barrier_wait(&sh->barrier);
+    }
+    // Every tile is FW_BLOCK^3 min(c, a+b), less the rows skipped for having no path to k
+    INSTR_ADD(INSTR_RELAX, tiles * FW_BLOCK * FW_BLOCK * FW_BLOCK);
+    INSTR_END(mark, PHASE_COMPUTE);
+    return NULL;
+}
+
+int fw_all(const struct csr_graph *g, int *dist, int nthreads) {
+    int n = g->n;
+    struct fw_shared sh;
+    sh.nb = (n + FW_BLOCK - 1) / FW_BLOCK;
+    sh.N = sh.nb * FW_BLOCK;
+    sh.nthreads = nthreads > 0 ? nthreads : 1;
+
+    // Work in place when n is already a multiple of the tile size, otherwise in a padded copy
+    // Padding nodes have no edges, so they never change a real distance
+    if (sh.N == n) {
+        sh.d = dist;
+    } else if (posix_memalign((void **)&sh.d, 64, sizeof(int) * (size_t)sh.N * sh.N)) {
+        printf("FW_ALL: out of memory for a padded %d x %d matrix\n", sh.N, sh.N);
+        return -1;
+    }
+    pthread_t *threads = malloc(sh.nthreads * sizeof(pthread_t));
+    struct fw_thread *args = malloc(sh.nthreads * sizeof(struct fw_thread));
+    if (threads == NULL || args == NULL) {
+        printf("FW_ALL: out of memory for %d threads\n", sh.nthreads);
+        free(threads);
+        free(args);
+        if (sh.d != dist)
+            free(sh.d);
+        return -1;
+    }
+
+    for (size_t i=0; i < (size_t)sh.N * sh.N; i++)
+        sh.d[i] = FW_INF;
+    for (int u=0; u < sh.N; u++)
+        sh.d[(size_t)u * sh.N + u] = 0;
+    for (int u=0; u < n; u++) {
+        for (int64_t e=g->off[u]; e < g->off[u+1]; e++) {
+            int v = g->adj[e];
+            int w = g->w ? g->w[e] : 1;
+            if (w < sh.d[(size_t)u * sh.N + v])
+                sh.d[(size_t)u * sh.N + v] = w;
+        }
+    }
+
+    pthread_barrier_init(&sh.barrier, NULL, sh.nthreads);
+    for (int t=0; t < sh.nthreads; t++) {
+        args[t].tid = t;
+        args[t].sh = &sh;
+    }
+    // The calling thread is worker 0, so the serial program never creates a thread
+    for (int t=1; t < sh.nthreads; t++) {
+        int rc = pthread_create(&threads[t], NULL, fw_worker, &args[t]);
+        if (rc) {
+            printf("ERROR; return code from pthread_create() is %d\n", rc);
+            exit(-1);
+        }
+    }
+    fw_worker(&args[0]);
+    for (int t=1; t < sh.nthreads; t++)
+        pthread_join(threads[t], NULL);
+    pthread_barrier_destroy(&sh.barrier);
+    free(threads);
+    free(args);
+
+    // Copy out of the padding (if any) and switch FW_INF back to NC
+    for (int i=0; i < n; i++) {
+        for (int j=0; j < n; j++) {
+            int v = sh.d[(size_t)i * sh.N + j];
+            dist[(size_t)i * n + j] = v >= FW_INF ? NC : v;
+        }
+    }
+    if (sh.d != dist)
+        free(sh.d);
+    return 0;
+}
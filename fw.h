@@ -0,0 +1,29 @@
+#ifndef FW_H
+#define FW_H
+
+#include "graph.h"
+
+// Tile edge length, 64*64 ints = 16KB so the three tiles a step touches sit in L1/L2
+#ifndef FW_BLOCK
+#define FW_BLOCK 64
+#endif
+
+/*
+Inside the kernel "no path" is FW_INF = INT_MAX/2 instead of NC
+That way FW_INF + FW_INF still fits in an int, so the SIMD add never has to check for NC first
+Any sum >= FW_INF loses the min against the FW_INF already stored, so nothing above FW_INF is ever kept
+The price is that a real distance of FW_INF or more comes out as NC (engine_select checks for that)
+*/
+#define FW_INF (INT_MAX / 2)
+
+/*
+Cache blocked Floyd-Warshall over the whole n*n matrix
+For every block k: (1) the diagonal tile, (2) the tiles in block row/column k, (3) every other tile
+Phases 2 and 3 are split over nthreads pthreads, with a barrier between phases
+The inner tile loop is AVX2/AVX-512 min/add when the compiler targets it
+dist must hold n*n ints, and ends up exactly what dijkstra_all produces (NC for no path)
+Returns 0 on success
+*/
+int fw_all(const struct csr_graph *g, int *dist, int nthreads);
+
+#endif
@@ -0,0 +1,320 @@
+#define _POSIX_C_SOURCE 200809L // sysconf
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "gen.h"
+
+// Seeds are xor'ed with these so the weights and R-MAT's edges never reuse the numbers of the row streams
+#define WEIGHT_SALT 0x5745494748545321ULL
+#define RMAT_SALT 0x524d41545f454447ULL
+// R-MAT quadrant probabilities (the fourth is 1 - the rest)
+#define RMAT_A 0.57
+#define RMAT_B 0.19
+#define RMAT_C 0.19
+
+static uint64_t mix(uint64_t z) {
+    z += 0x9e3779b97f4a7c15ULL;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+uint64_t gen_random(uint64_t seed, uint64_t stream, uint64_t counter) {
+    return mix(mix(mix(seed) ^ stream) ^ counter);
+}
+
+double gen_uniform(uint64_t seed, uint64_t stream, uint64_t counter) {
+    // The top 53 bits, plus one so the result is never 0
+    return (double)((gen_random(seed, stream, counter) >> 11) + 1) * (1.0 / 9007199254740992.0);
+}
+
+// Everything the passes below need, shared by every thread of one pass
+struct gen_job {
+    const struct run_config *cfg;
+    struct csr_graph *g;
+    int nthreads;
+    int64_t (*row)(const struct gen_job *j, int u, int *adj); // er_row or grid_row
+    double log_q; // er: log(1 - p)
+    int width; // grid: nodes per row of the grid
+    int *src, *dst; // rmat: the edge list
+    int64_t *kept; // rmat: edges left in every row after dropping duplicates
+    void (*fn)(struct gen_job *j, int64_t lo, int64_t hi);
+};
+
+struct gen_block {
+    struct gen_job *job;
+    int64_t lo, hi;
+};
+
+static void *gen_worker(void *arg) {
+    struct gen_block *b = (struct gen_block *) arg;
+    b->job->fn(b->job, b->lo, b->hi);
+    return NULL;
+}
+
+// Runs fn over [0, count) in one contiguous block per thread, the calling thread doing the first block
+static void run_blocks(struct gen_job *j, void (*fn)(struct gen_job *, int64_t, int64_t), int64_t count) {
+    int nthreads = count < j->nthreads ? (int)(count > 0 ? count : 1) : j->nthreads;
+    j->fn = fn;
+    pthread_t *threads = malloc(nthreads * sizeof(pthread_t));
+    struct gen_block *blocks = malloc(nthreads * sizeof(struct gen_block));
+    if (threads == NULL || blocks == NULL) {
+        printf("GEN: out of memory for %d threads\n", nthreads);
+        exit(-1);
+    }
+    for (int t=0; t < nthreads; t++) {
+        blocks[t].job = j;
+        blocks[t].lo = count * t / nthreads;
+        blocks[t].hi = count * (t+1) / nthreads;
+    }
+    for (int t=1; t < nthreads; t++) {
+        int rc = pthread_create(&threads[t], NULL, gen_worker, &blocks[t]);
+        if (rc) {
+            printf("ERROR; return code from pthread_create() is %d\n", rc);
+            exit(-1);
+        }
+    }
+    gen_worker(&blocks[0]);
+    for (int t=1; t < nthreads; t++)
+        pthread_join(threads[t], NULL);
+    free(threads);
+    free(blocks);
+}
+
+/*
+Erdos-Renyi row u: instead of flipping a coin for every v, jump straight to the next edge
+The number of misses before the next hit is geometric, P(s) = (1-p)^s p, which is floor(log(U) / log(1-p))
+The counter is just how many jumps the row has taken, so the row depends on (seed, u) and nothing else
+Self loops are skipped rather than redrawn, which leaves every other pair at exactly p
+Fills adj when it isn't NULL, returns the out degree either way
+*/
+static int64_t er_row(const struct gen_job *j, int u, int *adj) {
+    int n = j->g->n;
+    int64_t deg = 0;
+    uint64_t k = 0;
+    for (int64_t v = -1;;) {
+        // p = 1 makes log_q -inf, and every skip 0
+        double skip = log(gen_uniform(j->cfg->seed, u, k++)) / j->log_q;
+        if (skip >= n - v)
+            break;
+        v += 1 + (int64_t)skip;
+        if (v >= n)
+            break;
+        if (v == u)
+            continue;
+        if (adj != NULL)
+            adj[deg] = (int)v;
+        deg++;
+    }
+    return deg;
+}
+
+// Grid row u: up, left, right, down (already in order), whichever of them exist
+static int64_t grid_row(const struct gen_job *j, int u, int *adj) {
+    int n = j->g->n, w = j->width;
+    int nb[4], deg = 0;
+    if (u >= w)
+        nb[deg++] = u - w;
+    if (u % w > 0)
+        nb[deg++] = u - 1;
+    if (u % w < w - 1 && u + 1 < n)
+        nb[deg++] = u + 1;
+    if ((int64_t)u + w < n)
+        nb[deg++] = u + w;
+    if (adj != NULL)
+        memcpy(adj, nb, deg * sizeof(int));
+    return deg;
+}
+
+// Pass 1: out degree of every row, one slot ahead so the prefix sum lands in place (same as csr_generate)
+static void count_rows(struct gen_job *j, int64_t lo, int64_t hi) {
+    for (int64_t u=lo; u < hi; u++)
+        j->g->off[u+1] = j->row(j, (int)u, NULL);
+}
+
+// Pass 2: the same rows again, this time written into their place
+static void fill_rows(struct gen_job *j, int64_t lo, int64_t hi) {
+    for (int64_t u=lo; u < hi; u++)
+        j->row(j, (int)u, j->g->adj + j->g->off[u]);
+}
+
+// Builds g out of j->row for every node, in the two passes above
+static int gen_rows(struct gen_job *j) {
+    struct csr_graph *g = j->g;
+    int n = g->n;
+    g->off = calloc(n + 1, sizeof(int64_t));
+    if (g->off == NULL) {
+        printf("GEN: could not allocate offsets for %d nodes\n", n);
+        return -1;
+    }
+    run_blocks(j, count_rows, n);
+    for (int u=0; u < n; u++)
+        g->off[u+1] += g->off[u];
+    g->nnz = g->off[n];
+    g->adj = malloc((g->nnz > 0 ? g->nnz : 1) * sizeof(int));
+    if (g->adj == NULL) {
+        printf("GEN: could not allocate %lld edges\n", (long long)g->nnz);
+        csr_free(g);
+        return -1;
+    }
+    run_blocks(j, fill_rows, n);
+    return 0;
+}
+
+/*
+R-MAT edge k: the adjacency matrix is split in four, one quarter is picked, and that quarter is split again,
+once for every bit of the node numbers. Picks that land past n (when n is not a power of 2) are redrawn
+Every draw is counted from k, so the edges can be made in any order
+*/
+static void rmat_edges(struct gen_job *j, int64_t lo, int64_t hi) {
+    int n = j->g->n;
+    int levels = 0;
+    while ((1L << levels) < n)
+        levels++;
+    uint64_t seed = j->cfg->seed ^ RMAT_SALT;
+    for (int64_t k=lo; k < hi; k++) {
+        int64_t src, dst;
+        uint64_t c = 0;
+        do {
+            src = dst = 0;
+            for (int l = levels - 1; l >= 0; l--) {
+                double r = gen_uniform(seed, k, c++);
+                if (r > RMAT_A + RMAT_B + RMAT_C)
+                    src |= 1L << l, dst |= 1L << l;
+                else if (r > RMAT_A + RMAT_B)
+                    src |= 1L << l;
+                else if (r > RMAT_A)
+                    dst |= 1L << l;
+            }
+        } while (src >= n || dst >= n);
+        j->src[k] = (int)src;
+        j->dst[k] = (int)dst;
+    }
+}
+
+static int compare_int(const void *a, const void *b) {
+    int x = *(const int *)a, y = *(const int *)b;
+    return (x > y) - (x < y);
+}
+
+// Sorts every row and squeezes out its duplicates, leaving how many were kept in j->kept
+static void dedupe_rows(struct gen_job *j, int64_t lo, int64_t hi) {
+    const struct csr_graph *g = j->g;
+    for (int64_t u=lo; u < hi; u++) {
+        int *row = g->adj + g->off[u];
+        int64_t deg = g->off[u+1] - g->off[u], kept = 0;
+        qsort(row, deg, sizeof(int), compare_int);
+        for (int64_t e=0; e < deg; e++)
+            if (kept == 0 || row[e] != row[kept-1])
+                row[kept++] = row[e];
+        j->kept[u] = kept;
+    }
+}
+
+static int gen_rmat(struct gen_job *j) {
+    struct csr_graph *g = j->g;
+    int n = g->n;
+    int64_t edges = (int64_t)((double)n * (n - 1) * j->cfg->split / 100.0 + 0.5);
+    j->src = malloc((edges > 0 ? edges : 1) * sizeof(int));
+    j->dst = malloc((edges > 0 ? edges : 1) * sizeof(int));
+    j->kept = malloc(n * sizeof(int64_t));
+    if (j->src == NULL || j->dst == NULL || j->kept == NULL) {
+        printf("GEN: could not allocate %lld R-MAT edges\n", (long long)edges);
+        free(j->src);
+        free(j->dst);
+        free(j->kept);
+        return -1;
+    }
+    run_blocks(j, rmat_edges, edges);
+    // Grouping by source is one O(E) counting sort, which also drops the self loops
+    int rc = csr_from_edges(g, n, edges, j->src, j->dst, NULL);
+    free(j->src);
+    free(j->dst);
+    if (rc) {
+        free(j->kept);
+        return -1;
+    }
+    run_blocks(j, dedupe_rows, n);
+    // Close the gaps the duplicates left, rows only ever move down so this can be done in place
+    int64_t at = 0;
+    for (int u=0; u < n; u++) {
+        memmove(g->adj + at, g->adj + g->off[u], j->kept[u] * sizeof(int));
+        g->off[u] = at;
+        at += j->kept[u];
+    }
+    g->off[n] = at;
+    g->nnz = at;
+    free(j->kept);
+    return 0;
+}
+
+static void weigh_rows(struct gen_job *j, int64_t lo, int64_t hi) {
+    const struct csr_graph *g = j->g;
+    uint64_t seed = j->cfg->seed ^ WEIGHT_SALT;
+    for (int64_t u=lo; u < hi; u++)
+        for (int64_t e=g->off[u]; e < g->off[u+1]; e++)
+            g->w[e] = 1 + (int)(gen_random(seed, u, g->adj[e]) % (uint64_t)j->cfg->max_weight);
+}
+
+int gen_graph(struct csr_graph *g, const struct run_config *cfg) {
+    int n = cfg->n;
+    if (cfg->gen == GEN_LEGACY) {
+        if (csr_generate(g, n, cfg->split, cfg->seed))
+            return -1;
+    } else {
+        g->n = n;
+        g->nnz = 0;
+        g->off = NULL;
+        g->adj = NULL;
+        g->w = NULL;
+        g->map = NULL;
+        g->map_len = 0;
+    }
+
+    struct gen_job j;
+    memset(&j, 0, sizeof(j));
+    j.cfg = cfg;
+    j.g = g;
+    j.nthreads = cfg->threads;
+    if (j.nthreads <= 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        j.nthreads = cpus > 0 ? (int)cpus : 1;
+    }
+
+    int rc = 0;
+    if (cfg->gen == GEN_ER) {
+        if (cfg->split == 0) {
+            g->off = calloc(n + 1, sizeof(int64_t));
+            g->adj = malloc(sizeof(int));
+            rc = g->off == NULL || g->adj == NULL ? -1 : 0;
+        } else {
+            j.row = er_row;
+            j.log_q = log(1.0 - cfg->split / 100.0);
+            rc = gen_rows(&j);
+        }
+    } else if (cfg->gen == GEN_GRID) {
+        j.row = grid_row;
+        j.width = (int)sqrt((double)n);
+        while ((int64_t)j.width * j.width < n)
+            j.width++;
+        rc = gen_rows(&j);
+    } else if (cfg->gen == GEN_RMAT) {
+        rc = gen_rmat(&j);
+    }
+    if (rc)
+        return -1;
+
+    if (cfg->max_weight > 1) {
+        g->w = malloc((g->nnz > 0 ? g->nnz : 1) * sizeof(int));
+        if (g->w == NULL) {
+            printf("GEN: could not allocate %lld weights\n", (long long)g->nnz);
+            csr_free(g);
+            return -1;
+        }
+        run_blocks(&j, weigh_rows, n);
+    }
+    return 0;
+}
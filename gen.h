@@ -0,0 +1,36 @@
+#ifndef GEN_H
+#define GEN_H
+
+#include <stdint.h>
+#include "config.h"
+#include "graph.h"
+
+/*
+Counter based random numbers: every value is a hash of (seed, stream, counter) instead of the next
+state of one shared sequence, so a row (stream = its source node) or an edge (stream = its index) can be
+drawn on any thread or processor, in any order, and always comes out the same
+The hash is SplitMix64's finalizer applied to the three in turn: a few multiplies per number,
+and no state to share between threads the way rand() does
+*/
+uint64_t gen_random(uint64_t seed, uint64_t stream, uint64_t counter);
+// Same, as a double in (0, 1] (never 0, so its log is always finite)
+double gen_uniform(uint64_t seed, uint64_t stream, uint64_t counter);
+
+/*
+Generates the graph cfg asks for (-G) straight into CSR, on cfg->threads threads (0 = one per CPU online)
+    legacy  csr_generate, the original srand(seed)/rand() graph that the reference outputs were made with
+            It walks all n^2 pairs on one thread, the others below only pay for the edges they make
+    er      Erdos-Renyi: every u->v (u != v) independently with probability split%
+            Each row jumps straight from one edge to the next by a geometric skip, O(out degree) per row
+    rmat    R-MAT: split% of n*(n-1) edges, each one placed by picking a quadrant of the adjacency matrix
+            with probabilities 0.57/0.19/0.19/0.05 (Graph500's) at every level, which gives the skewed degrees
+            and hubs of real networks. Duplicate edges and self loops are dropped
+    grid    2D grid, ceil(sqrt(n)) nodes wide, with edges both ways between neighbors. split is ignored
+            Degree 4 and O(sqrt(n)) hops across, the opposite of the other generators' tiny diameters
+Every generator gives the same graph for the same seed no matter how many threads made it
+With cfg->max_weight > 1 every edge u->v gets a weight in 1:max_weight drawn from (seed, u, v),
+so the same edge has the same weight under every generator. Returns 0 on success
+*/
+int gen_graph(struct csr_graph *g, const struct run_config *cfg);
+
+#endif
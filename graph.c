@@ -0,0 +1,178 @@
+#define _POSIX_C_SOURCE 200809L // munmap
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include "graph.h"
+
+/*
+The original generator walks m row by row, and m[i][j] = 1 means j->i
+CSR wants the edges grouped by their source (j), so this makes two passes over the same
+random sequence: the first counts how many edges leave every node, the second fills them in
+Re-seeding between passes guarantees both passes see identical rand() values
+Because i only increases, each adjacency list comes out sorted
+*/
+int csr_generate(struct csr_graph *g, int n, int split, unsigned int seed) {
+    g->n = n;
+    g->nnz = 0;
+    g->adj = NULL;
+    g->w = NULL;
+    g->map = NULL;
+    g->map_len = 0;
+    g->off = calloc(n + 1, sizeof(int64_t));
+    if (g->off == NULL) {
+        printf("CSR_GENERATE: could not allocate offsets for %d nodes\n", n);
+        return -1;
+    }
+
+    // Pass 1: out degree of every node, stored one slot ahead so the prefix sum lands in place
+    srand(seed);
+    for (int i=0; i < n; i++) {
+        for (int j=0; j < n; j++) {
+            // rand() has to be called for the diagonal too, or the sequence shifts
+            if (rand()%100 < split && i != j)
+                g->off[j+1]++;
+        }
+    }
+    for (int u=0; u < n; u++)
+        g->off[u+1] += g->off[u];
+    g->nnz = g->off[n];
+
+    g->adj = malloc((g->nnz > 0 ? g->nnz : 1) * sizeof(int));
+    int64_t *pos = malloc(n * sizeof(int64_t));
+    if (g->adj == NULL || pos == NULL) {
+        printf("CSR_GENERATE: could not allocate %lld edges\n", (long long)g->nnz);
+        free(pos);
+        csr_free(g);
+        return -1;
+    }
+    memcpy(pos, g->off, n * sizeof(int64_t));
+
+    // Pass 2: same sequence again, this time placing every edge
+    srand(seed);
+    for (int i=0; i < n; i++) {
+        for (int j=0; j < n; j++) {
+            if (rand()%100 < split && i != j)
+                g->adj[pos[j]++] = i;
+        }
+    }
+    free(pos);
+    return 0;
+}
+
+void csr_to_dense(const struct csr_graph *g, int *m) {
+    int n = g->n;
+    memset(m, 0, (size_t)n * n * sizeof(int));
+    for (int u=0; u < n; u++) {
+        for (int64_t e=g->off[u]; e < g->off[u+1]; e++) {
+            // Imported graphs can have parallel edges, only the lightest one matters
+            int *cell = &m[(size_t)g->adj[e] * n + u];
+            int w = g->w ? g->w[e] : 1;
+            if (*cell == 0 || w < *cell)
+                *cell = w;
+        }
+        // Matches the "set all diagonals to 1" step of the dense generator
+        m[(size_t)u * n + u] = 1;
+    }
+}
+
+int csr_from_edges(struct csr_graph *g, int n, int64_t nedges, const int *src, const int *dst, const int *w) {
+    g->n = n;
+    g->w = NULL;
+    g->map = NULL;
+    g->map_len = 0;
+    g->off = calloc(n + 1, sizeof(int64_t));
+    if (g->off == NULL)
+        return -1;
+    for (int64_t e=0; e < nedges; e++)
+        if (src[e] != dst[e])
+            g->off[src[e]+1]++;
+    for (int u=0; u < n; u++)
+        g->off[u+1] += g->off[u];
+    g->nnz = g->off[n];
+
+    g->adj = malloc((g->nnz > 0 ? g->nnz : 1) * sizeof(int));
+    if (w != NULL)
+        g->w = malloc((g->nnz > 0 ? g->nnz : 1) * sizeof(int));
+    int64_t *pos = malloc((n > 0 ? n : 1) * sizeof(int64_t));
+    if (g->adj == NULL || pos == NULL || (w != NULL && g->w == NULL)) {
+        printf("CSR_FROM_EDGES: could not allocate %lld edges\n", (long long)g->nnz);
+        free(pos);
+        csr_free(g);
+        return -1;
+    }
+    memcpy(pos, g->off, n * sizeof(int64_t));
+    for (int64_t e=0; e < nedges; e++) {
+        if (src[e] == dst[e])
+            continue;
+        int64_t p = pos[src[e]]++;
+        g->adj[p] = dst[e];
+        if (w != NULL)
+            g->w[p] = w[e];
+    }
+    free(pos);
+    return 0;
+}
+
+int csr_transpose(const struct csr_graph *g, struct csr_graph *rev) {
+    int n = g->n;
+    rev->n = n;
+    rev->nnz = g->nnz;
+    rev->map = NULL;
+    rev->map_len = 0;
+    rev->w = NULL;
+    rev->off = calloc(n + 1, sizeof(int64_t));
+    rev->adj = malloc((g->nnz > 0 ? g->nnz : 1) * sizeof(int));
+    if (g->w != NULL)
+        rev->w = malloc((g->nnz > 0 ? g->nnz : 1) * sizeof(int));
+    int64_t *pos = malloc((n > 0 ? n : 1) * sizeof(int64_t));
+    if (rev->off == NULL || rev->adj == NULL || pos == NULL || (g->w != NULL && rev->w == NULL)) {
+        printf("CSR_TRANSPOSE: could not allocate %lld edges\n", (long long)g->nnz);
+        free(pos);
+        csr_free(rev);
+        return -1;
+    }
+    // Same counting sort as csr_from_edges, keyed on the destination instead
+    for (int64_t e=0; e < g->nnz; e++)
+        rev->off[g->adj[e]+1]++;
+    for (int v=0; v < n; v++)
+        rev->off[v+1] += rev->off[v];
+    memcpy(pos, rev->off, n * sizeof(int64_t));
+    for (int u=0; u < n; u++) {
+        for (int64_t e=g->off[u]; e < g->off[u+1]; e++) {
+            int64_t p = pos[g->adj[e]]++;
+            rev->adj[p] = u;
+            if (g->w != NULL)
+                rev->w[p] = g->w[e];
+        }
+    }
+    free(pos);
+    return 0;
+}
+
+void csr_free(struct csr_graph *g) {
+    if (g->map != NULL) {
+        munmap(g->map, g->map_len);
+        g->map = NULL;
+    } else {
+        free(g->off);
+        free(g->adj);
+        free(g->w);
+    }
+    g->off = NULL;
+    g->adj = NULL;
+    g->w = NULL;
+}
+
+void print_row(const int r[], int N) {
+    // Print the values of the row
+    for (int j=0; j<N; j++)
+        printf("%d ", r[j]);
+    printf("\n");
+}
+void print_m(int n, const int *m) {
+    // Print matrix one row at a time
+    for (int i=0; i < n; i++)
+        print_row(&m[(size_t)i * n], n);
+    printf("\n");
+}
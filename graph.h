@@ -0,0 +1,65 @@
+#ifndef GRAPH_H
+#define GRAPH_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <limits.h>
+
+// Distance for No Connection (NC)
+// Used to be a multiple of M_SIZE picked per program, which collided with real distances once
+// the size changed. INT_MAX can never be a real distance, and every kernel checks for NC before adding
+#define NC INT_MAX
+
+/*
+d + w for a distance d (which may be NC) and an edge weight w >= 0, without ever overflowing
+A path too long for an int comes out NC, the same as no path, instead of wrapping around to a
+negative distance that would then win every comparison after it
+*/
+static inline int dist_add(int d, int w) {
+    return d > NC - w ? NC : d + w;
+}
+
+/*
+Compressed sparse row (CSR) storage of the graph
+The dense programs store the edge u->j in m[j][u] (connections are in the columns of m)
+Here the same edge is stored once, in the adjacency list of u, so a settled node's neighbors
+can be walked contiguously instead of striding down an entire column of m
+The edges leaving u are adj[off[u]] : adj[off[u+1]-1] (and their weights are w[...] at the same indeces)
+w is NULL when every edge has weight 1
+Self loops are dropped, they can never shorten a path
+Memory is O(V+E) instead of O(V^2)
+*/
+struct csr_graph {
+    int n; // number of nodes
+    int64_t nnz; // number of edges
+    int64_t *off; // n+1 offsets into adj/w
+    int *adj; // destination node of every edge
+    int *w; // weight of every edge, NULL when unweighted
+    void *map; // when loaded from a binary graph file, the mmap'd file the arrays point into (see graphio.h)
+    size_t map_len;
+};
+
+// Builds the same graph main() used to build into m (srand(seed), rand()%100 < split),
+// but straight into CSR form so the V^2 matrix never has to exist. Returns 0 on success
+int csr_generate(struct csr_graph *g, int n, int split, unsigned int seed);
+// Expands g back into the dense layout (m[j][u] = weight of u->j, diagonals set to 1)
+// Used for printing, and by the dense engine
+void csr_to_dense(const struct csr_graph *g, int *m);
+/*
+Builds a CSR graph out of a plain list of edges src[e]->dst[e] (weight w[e], or 1 when w is NULL)
+Counting sort by source, so it is O(V+E). Self loops are dropped, duplicates are kept
+Returns 0 on success
+*/
+int csr_from_edges(struct csr_graph *g, int n, int64_t nedges, const int *src, const int *dst, const int *w);
+// Builds rev, the graph with every edge of g reversed (the in-edges of every node), for backward searches
+// Returns 0 on success
+int csr_transpose(const struct csr_graph *g, struct csr_graph *rev);
+// Frees the arrays, or unmaps them when g was mapped from a file
+void csr_free(struct csr_graph *g);
+
+// I wrote these prints as a proof-of-concept regarding passing a single row of the matrix to a function
+// And also to see the matrix was generated sufficiently
+void print_row(const int r[], int N);
+void print_m(int n, const int *m);
+
+#endif
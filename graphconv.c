@@ -0,0 +1,30 @@
+#define _POSIX_C_SOURCE 200809L // optind
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h> // optind
+#include "graphio.h"
+
+/*
+Writes a graph in the binary format, so serial, tight and loose can mmap it with -f
+    ./graphconv.o -n 100000 -d 1 -s 7 out.bin      the generated graph
+    ./graphconv.o -n 50000 -d 1 -G rmat -W 10 out.bin  any of the other generators (see gen.h), made on every core
+    ./graphconv.o -f roads.gr out.bin              a DIMACS (or edge list) file
+The conversion is the only time the text gets parsed, every run after that starts from the mapping
+*/
+int main(int argc, char *argv[]) {
+    struct run_config cfg;
+    if (parse_args(argc, argv, &cfg))
+        exit(-1);
+    if (optind != argc - 1) {
+        printf("Usage: %s [-n nodes] [-d split] [-s seed] [-G generator] [-W max weight] [-t threads] [-f input file] output.bin\n", argv[0]);
+        exit(-1);
+    }
+
+    struct csr_graph g;
+    if (graph_from_config(&cfg, &g))
+        exit(-1);
+    if (graph_save(argv[optind], &g))
+        exit(-1);
+    printf("Wrote %s: %d nodes, %lld edges, %s\n", argv[optind], g.n, (long long)g.nnz, g.w ? "weighted" : "unit weights");
+    csr_free(&g);
+}
@@ -0,0 +1,288 @@
+#define _POSIX_C_SOURCE 200809L // getline, mmap, fstat
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "gen.h"
+#include "graphio.h"
+
+// Offsets of the arrays in a binary file
+static size_t adj_offset(int64_t n) {
+    return sizeof(struct graph_file_header) + (size_t)(n + 1) * sizeof(int64_t);
+}
+static size_t w_offset(int64_t n, int64_t nnz) {
+    size_t end = adj_offset(n) + (size_t)nnz * sizeof(int);
+    return (end + 7) / 8 * 8;
+}
+
+bool graph_file_is_binary(const char *path) {
+    char magic[8];
+    FILE *f = fopen(path, "rb");
+    if (f == NULL)
+        return false;
+    bool binary = fread(magic, 1, 8, f) == 8 && memcmp(magic, GRAPH_FILE_MAGIC, 8) == 0;
+    fclose(f);
+    return binary;
+}
+
+static int map_binary(const char *path, struct csr_graph *g) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        printf("GRAPH_LOAD: could not open %s\n", path);
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) || (size_t)st.st_size < sizeof(struct graph_file_header)) {
+        printf("GRAPH_LOAD: %s is too small to be a graph file\n", path);
+        close(fd);
+        return -1;
+    }
+    char *base = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    // The mapping stays valid after the descriptor is closed
+    close(fd);
+    if (base == MAP_FAILED) {
+        printf("GRAPH_LOAD: could not mmap %s\n", path);
+        return -1;
+    }
+
+    const struct graph_file_header *h = (const struct graph_file_header *) base;
+    bool weighted = h->flags & GRAPH_FILE_WEIGHTED;
+    // n and nnz are held to what the file could hold before they go into any offset, so a huge header value
+    // can't wrap need around to something small
+    size_t size = st.st_size, body = size - sizeof(struct graph_file_header);
+    bool fits = h->n > 0 && h->n <= INT_MAX && (size_t)h->n < body / sizeof(int64_t) &&
+                h->nnz >= 0 && (size_t)h->nnz <= (size - adj_offset(h->n)) / sizeof(int) / (weighted ? 2 : 1);
+    size_t need = !fits ? SIZE_MAX : weighted ? w_offset(h->n, h->nnz) + (size_t)h->nnz * sizeof(int)
+                                              : adj_offset(h->n) + (size_t)h->nnz * sizeof(int);
+    if (h->version != GRAPH_FILE_VERSION || !fits || size < need) {
+        printf("GRAPH_LOAD: %s has a bad header or is truncated\n", path);
+        munmap(base, st.st_size);
+        return -1;
+    }
+
+    // The arrays are used right where they sit in the file, nothing is copied
+    // (They are only ever read, the casts just drop the const the engines never needed)
+    g->n = (int) h->n;
+    g->nnz = h->nnz;
+    g->off = (int64_t *) (base + sizeof(struct graph_file_header));
+    g->adj = (int *) (base + adj_offset(h->n));
+    g->w = weighted ? (int *) (base + w_offset(h->n, h->nnz)) : NULL;
+    g->map = base;
+    g->map_len = st.st_size;
+    if (g->off[0] != 0 || g->off[g->n] != g->nnz) {
+        printf("GRAPH_LOAD: %s has inconsistent offsets\n", path);
+        csr_free(g);
+        return -1;
+    }
+    // Every engine indexes with these unchecked, so one pass over the file to hold it to what the importers
+    // let through (edge_push): offsets that never go back, and edges to real nodes with positive weights
+    for (int u=0; u < g->n; u++) {
+        if (g->off[u+1] < g->off[u]) {
+            printf("GRAPH_LOAD: %s has decreasing offsets at node %d\n", path, u);
+            csr_free(g);
+            return -1;
+        }
+    }
+    for (int64_t e=0; e < g->nnz; e++) {
+        if (g->adj[e] < 0 || g->adj[e] >= g->n || (g->w && g->w[e] < 1)) {
+            printf("GRAPH_LOAD: %s has a bad edge %lld (to %d, weight %d)\n", path, (long long)e, g->adj[e], g->w ? g->w[e] : 1);
+            csr_free(g);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int graph_load(const char *path, struct csr_graph *g) {
+    if (graph_file_is_binary(path))
+        return map_binary(path, g);
+    size_t len = strlen(path);
+    if (len >= 3 && strcmp(path + len - 3, ".gr") == 0)
+        return import_dimacs(path, g);
+    return import_edge_list(path, g);
+}
+
+int graph_from_config(struct run_config *cfg, struct csr_graph *g) {
+    if (cfg->file == NULL)
+        return gen_graph(g, cfg);
+    if (graph_load(cfg->file, g))
+        return -1;
+    cfg->n = g->n;
+    if (cfg->n <= 100)
+        cfg->print = true;
+    return 0;
+}
+
+int graph_save(const char *path, const struct csr_graph *g) {
+    FILE *f = fopen(path, "wb");
+    if (f == NULL) {
+        printf("GRAPH_SAVE: could not create %s\n", path);
+        return -1;
+    }
+    struct graph_file_header h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, GRAPH_FILE_MAGIC, 8);
+    h.version = GRAPH_FILE_VERSION;
+    h.flags = g->w ? GRAPH_FILE_WEIGHTED : 0;
+    h.n = g->n;
+    h.nnz = g->nnz;
+
+    bool ok = fwrite(&h, sizeof(h), 1, f) == 1;
+    ok = ok && fwrite(g->off, sizeof(int64_t), g->n + 1, f) == (size_t)g->n + 1;
+    ok = ok && fwrite(g->adj, sizeof(int), g->nnz, f) == (size_t)g->nnz;
+    if (g->w) {
+        static const char pad[8] = {0};
+        size_t padding = w_offset(g->n, g->nnz) - (adj_offset(g->n) + (size_t)g->nnz * sizeof(int));
+        ok = ok && fwrite(pad, 1, padding, f) == padding;
+        ok = ok && fwrite(g->w, sizeof(int), g->nnz, f) == (size_t)g->nnz;
+    }
+    ok = (fclose(f) == 0) && ok;
+    if (!ok)
+        printf("GRAPH_SAVE: error writing %s\n", path);
+    return ok ? 0 : -1;
+}
+
+// Growable list of edges, filled by the text importers and then turned into CSR
+struct edge_list {
+    int64_t count, capacity;
+    int *src, *dst, *w;
+    bool weighted; // at least one edge had a weight other than 1
+};
+
+// Weights must be positive, m uses 0 for "no connection"
+static int edge_push(struct edge_list *el, long src, long dst, long w) {
+    if (src < 0 || dst < 0 || src >= INT_MAX || dst >= INT_MAX || w < 1 || w > INT_MAX) {
+        printf("GRAPH IMPORT: bad edge %ld -> %ld (weight %ld)\n", src, dst, w);
+        return -1;
+    }
+    if (el->count == el->capacity) {
+        el->capacity = el->capacity ? el->capacity * 2 : 1024;
+        el->src = realloc(el->src, el->capacity * sizeof(int));
+        el->dst = realloc(el->dst, el->capacity * sizeof(int));
+        el->w = realloc(el->w, el->capacity * sizeof(int));
+        if (el->src == NULL || el->dst == NULL || el->w == NULL) {
+            printf("GRAPH IMPORT: out of memory at %lld edges\n", (long long)el->count);
+            return -1;
+        }
+    }
+    el->src[el->count] = (int) src;
+    el->dst[el->count] = (int) dst;
+    el->w[el->count] = (int) w;
+    el->count++;
+    if (w != 1)
+        el->weighted = true;
+    return 0;
+}
+
+// Builds g from the list (dropping the weights when they are all 1) and frees the list
+static int edge_list_finish(struct edge_list *el, int n, struct csr_graph *g) {
+    int rc = csr_from_edges(g, n, el->count, el->src, el->dst, el->weighted ? el->w : NULL);
+    free(el->src);
+    free(el->dst);
+    free(el->w);
+    return rc;
+}
+
+int import_edge_list(const char *path, struct csr_graph *g) {
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+        printf("IMPORT_EDGE_LIST: could not open %s\n", path);
+        return -1;
+    }
+    struct edge_list el = {0};
+    long max_node = -1;
+    char *line = NULL;
+    size_t cap = 0;
+    int rc = 0;
+    while (getline(&line, &cap, f) > 0) {
+        char *p = line;
+        while (*p == ' ' || *p == '\t')
+            p++;
+        if (*p == '#' || *p == '%' || *p == '\n' || *p == '\r' || *p == '\0')
+            continue;
+        char *q;
+        long src = strtol(p, &q, 10);
+        long dst = strtol(q, &p, 10);
+        if (p == q) {
+            printf("IMPORT_EDGE_LIST: can't read line: %s", line);
+            rc = -1;
+            break;
+        }
+        long w = strtol(p, &q, 10);
+        if (q == p)
+            w = 1; // no weight column
+        if (edge_push(&el, src, dst, w)) {
+            rc = -1;
+            break;
+        }
+        if (src > max_node)
+            max_node = src;
+        if (dst > max_node)
+            max_node = dst;
+    }
+    free(line);
+    fclose(f);
+    if (rc == 0 && max_node < 0) {
+        printf("IMPORT_EDGE_LIST: %s has no edges\n", path);
+        rc = -1;
+    }
+    if (rc) {
+        free(el.src);
+        free(el.dst);
+        free(el.w);
+        return rc;
+    }
+    return edge_list_finish(&el, (int)(max_node + 1), g);
+}
+
+int import_dimacs(const char *path, struct csr_graph *g) {
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+        printf("IMPORT_DIMACS: could not open %s\n", path);
+        return -1;
+    }
+    struct edge_list el = {0};
+    long n = -1;
+    char *line = NULL;
+    size_t cap = 0;
+    int rc = 0;
+    while (getline(&line, &cap, f) > 0) {
+        if (line[0] == 'p') {
+            long arcs;
+            if (sscanf(line, "p sp %ld %ld", &n, &arcs) != 2 || n <= 0 || n >= INT_MAX) {
+                printf("IMPORT_DIMACS: bad problem line: %s", line);
+                rc = -1;
+                break;
+            }
+        } else if (line[0] == 'a') {
+            long src, dst, w;
+            if (n < 0 || sscanf(line, "a %ld %ld %ld", &src, &dst, &w) != 3 || src < 1 || src > n || dst < 1 || dst > n) {
+                printf("IMPORT_DIMACS: bad arc line: %s", line);
+                rc = -1;
+                break;
+            }
+            // DIMACS numbers nodes from 1
+            if (edge_push(&el, src - 1, dst - 1, w)) {
+                rc = -1;
+                break;
+            }
+        }
+        // 'c' comments and anything else are skipped
+    }
+    free(line);
+    fclose(f);
+    if (rc == 0 && n < 0) {
+        printf("IMPORT_DIMACS: %s has no problem line\n", path);
+        rc = -1;
+    }
+    if (rc) {
+        free(el.src);
+        free(el.dst);
+        free(el.w);
+        return rc;
+    }
+    return edge_list_finish(&el, (int) n, g);
+}
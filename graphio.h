@@ -0,0 +1,66 @@
+#ifndef GRAPHIO_H
+#define GRAPHIO_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "config.h"
+#include "graph.h"
+
+/*
+Binary graph file: the CSR arrays exactly as they sit in memory, so loading is just an mmap
+    header (32 bytes, below)
+    off[n+1]  int64
+    adj[nnz]  int32
+    w[nnz]    int32, only when flags has GRAPH_FILE_WEIGHTED
+Everything is little endian (the byte order of every machine we run on), and every array starts
+on an 8 byte boundary, so the pointers into the mapping are properly aligned
+*/
+#define GRAPH_FILE_MAGIC "APSPCSR1"
+#define GRAPH_FILE_VERSION 1
+#define GRAPH_FILE_WEIGHTED 1u
+
+struct graph_file_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t flags;
+    int64_t n;
+    int64_t nnz;
+};
+
+// true when path starts with GRAPH_FILE_MAGIC
+bool graph_file_is_binary(const char *path);
+
+/*
+Loads the graph in path into g. Returns 0 on success
+Binary files are mmap'd read only: no parsing and no copying, the pages are faulted in as the
+engine touches them, and processors on one node all share the page cache's copy
+Anything else is imported as text: DIMACS when the name ends in .gr, a plain edge list otherwise
+csr_free releases either kind
+*/
+int graph_load(const char *path, struct csr_graph *g);
+
+/*
+The graph a run works on: loaded from cfg->file when one was given, generated from -n/-d/-s/-G/-W otherwise (see gen.h)
+Sets cfg->n to the node count of the graph (and turns printing on for small files, same as -n)
+Returns 0 on success
+*/
+int graph_from_config(struct run_config *cfg, struct csr_graph *g);
+
+// Writes g in the binary format. Returns 0 on success
+int graph_save(const char *path, const struct csr_graph *g);
+
+/*
+Edge list text: one edge per line, "src dst" or "src dst weight" (weights > 0), nodes numbered from 0
+Lines starting with # or % are comments. The node count is the largest node + 1
+*/
+int import_edge_list(const char *path, struct csr_graph *g);
+
+/*
+DIMACS shortest path (.gr) text, as used by the 9th DIMACS challenge:
+    c comment
+    p sp <nodes> <arcs>
+    a <src> <dst> <weight>     (nodes numbered from 1)
+*/
+int import_dimacs(const char *path, struct csr_graph *g);
+
+#endif
@@ -0,0 +1,311 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "apsp.h"
+#include "incremental.h"
+#include "timing.h"
+
+// One edge after merging the batch: its weight before and after (NC = no edge)
+struct edge_change {
+    int u, v;
+    int w_old, w_new;
+    int seq; // position in the batch, so the last update to an edge wins
+};
+
+static int by_edge(const void *a, const void *b) {
+    const struct edge_change *x = a, *y = b;
+    if (x->u != y->u)
+        return x->u < y->u ? -1 : 1;
+    return (x->v > y->v) - (x->v < y->v);
+}
+
+// Weight of u->v in g, the lightest one if there are parallel edges, NC if there is none
+static int edge_weight(const struct csr_graph *g, int u, int v) {
+    int best = NC;
+    for (int64_t e=g->off[u]; e < g->off[u+1]; e++)
+        if (g->adj[e] == v && (g->w ? g->w[e] : 1) < best)
+            best = g->w ? g->w[e] : 1;
+    return best;
+}
+
+/*
+Builds out = g with every edge in c (sorted by edge) replaced by its new weight (or removed)
+Just a rebuild through csr_from_edges, O(V+E), which is nothing next to repairing dist
+*/
+static int rebuild(const struct csr_graph *g, const struct edge_change *c, int count, struct csr_graph *out) {
+    int64_t cap = g->nnz + count;
+    int *src = malloc((cap > 0 ? cap : 1) * sizeof(int));
+    int *dst = malloc((cap > 0 ? cap : 1) * sizeof(int));
+    int *w = malloc((cap > 0 ? cap : 1) * sizeof(int));
+    if (src == NULL || dst == NULL || w == NULL) {
+        printf("APSP_UPDATE: out of memory for %lld edges\n", (long long)cap);
+        free(src);
+        free(dst);
+        free(w);
+        return -1;
+    }
+    int64_t m = 0;
+    for (int u=0; u < g->n; u++) {
+        for (int64_t e=g->off[u]; e < g->off[u+1]; e++) {
+            struct edge_change key = {.u = u, .v = g->adj[e]};
+            if (bsearch(&key, c, count, sizeof(struct edge_change), by_edge) != NULL)
+                continue;
+            src[m] = u;
+            dst[m] = g->adj[e];
+            w[m] = g->w ? g->w[e] : 1;
+            m++;
+        }
+    }
+    for (int i=0; i < count; i++) {
+        if (c[i].w_new == NC)
+            continue;
+        src[m] = c[i].u;
+        dst[m] = c[i].v;
+        w[m] = c[i].w_new;
+        m++;
+    }
+    int rc = csr_from_edges(out, g->n, m, src, dst, w);
+    free(src);
+    free(dst);
+    free(w);
+    return rc;
+}
+
+/*
+Ramalingam-Reps repair of one row (dist, exact for the graph before the increases) for the graph g
+rev is g transposed, inc the increased edges. aff must be all false, and is left that way
+Returns the number of nodes that had to be recomputed
+*/
+static int repair_row(const struct csr_graph *g, const struct csr_graph *rev, int *dist,
+                      const struct edge_change *inc, int ninc, bool *aff, int *list, struct min_heap *h) {
+    // The heads of changed edges that were on a shortest path are the first candidates
+    for (int i=0; i < ninc; i++) {
+        int u = inc[i].u, v = inc[i].v;
+        if (dist[u] != NC && dist_add(dist[u], inc[i].w_old) == dist[v])
+            heap_push_or_decrease(h, dist, v);
+    }
+
+    // Candidates come out in order of (old) distance, so every node that could support z
+    // (has a smaller distance) has already been decided by the time z is
+    int naff = 0;
+    while (h->size > 0) {
+        int z = heap_pop(h, dist);
+        bool supported = false;
+        for (int64_t e=rev->off[z]; e < rev->off[z+1] && !supported; e++) {
+            int p = rev->adj[e];
+            supported = !aff[p] && dist[p] != NC && dist_add(dist[p], rev->w ? rev->w[e] : 1) == dist[z];
+        }
+        if (supported)
+            continue;
+        aff[z] = true;
+        list[naff++] = z;
+        // z's distance is going up, so whatever hung off it in the shortest path DAG has to be checked too
+        for (int64_t e=g->off[z]; e < g->off[z+1]; e++) {
+            int c = g->adj[e];
+            if (!aff[c] && h->pos[c] < 0 && dist_add(dist[z], g->w ? g->w[e] : 1) == dist[c])
+                heap_push_or_decrease(h, dist, c);
+        }
+    }
+    if (naff == 0)
+        return 0;
+
+    // New distances of the affected nodes: start from their best in-edge from an unaffected node,
+    // then a dijkstra that only ever relaxes into affected nodes
+    for (int i=0; i < naff; i++)
+        dist[list[i]] = NC;
+    for (int i=0; i < naff; i++) {
+        int a = list[i];
+        for (int64_t e=rev->off[a]; e < rev->off[a+1]; e++) {
+            int p = rev->adj[e];
+            if (!aff[p] && dist_add(dist[p], rev->w ? rev->w[e] : 1) < dist[a])
+                dist[a] = dist_add(dist[p], rev->w ? rev->w[e] : 1);
+        }
+        if (dist[a] != NC)
+            heap_push_or_decrease(h, dist, a);
+    }
+    while (h->size > 0) {
+        int a = heap_pop(h, dist);
+        for (int64_t e=g->off[a]; e < g->off[a+1]; e++) {
+            int c = g->adj[e];
+            int alt = dist_add(dist[a], g->w ? g->w[e] : 1);
+            if (aff[c] && alt < dist[c]) {
+                dist[c] = alt;
+                heap_push_or_decrease(h, dist, c);
+            }
+        }
+    }
+    for (int i=0; i < naff; i++)
+        aff[list[i]] = false;
+    return naff;
+}
+
+/*
+Seconds a full recompute of the n rows with in would take, from timing UPDATE_SAMPLE_ROWS sources spread over the graph
+Rows are one apsp_row each, so for bfs (which does 64 sources at once) this errs on the long side
+*/
+static double recompute_estimate(const struct apsp_input *in, struct sssp_scratch *s) {
+    int n = in->n;
+    int rows = n < UPDATE_SAMPLE_ROWS ? n : UPDATE_SAMPLE_ROWS;
+    if (rows == 0)
+        return 0;
+    double t0 = wall_time();
+    for (int i=0; i < rows; i++)
+        apsp_row(in, (int)((int64_t)i * n / rows), s);
+    return (wall_time() - t0) * n / rows;
+}
+
+int apsp_update(struct csr_graph *g, struct dist_matrix *d, const struct edge_update *up, int count,
+                struct sssp_scratch *s, struct update_stats *st) {
+    double t0 = wall_time();
+    int n = g->n;
+    memset(st, 0, sizeof(*st));
+
+    // Merge the batch: one change per edge, the last update to it wins
+    int rc = -1;
+    struct edge_change *c = malloc((count > 0 ? count : 1) * sizeof(struct edge_change));
+    struct edge_change *inc = NULL, *dec = NULL;
+    int *buf = NULL;
+    // Every graph is built before d is touched, so a failure leaves both g and d the way they were
+    struct csr_graph g1 = {0}, g2 = {0}, rev = {0};
+    struct apsp_input in;
+    in.g = NULL;
+    if (c == NULL) {
+        printf("APSP_UPDATE: out of memory for %d updates\n", count);
+        goto done;
+    }
+    int nc = 0;
+    for (int i=0; i < count; i++) {
+        if (up[i].u < 0 || up[i].u >= n || up[i].v < 0 || up[i].v >= n || (up[i].op == EDGE_SET && up[i].w < 1)) {
+            printf("APSP_UPDATE: bad update %d -> %d (weight %d)\n", up[i].u, up[i].v, up[i].w);
+            goto done;
+        }
+        // Self loops never change a distance
+        if (up[i].u == up[i].v)
+            continue;
+        c[nc].u = up[i].u;
+        c[nc].v = up[i].v;
+        c[nc].w_new = up[i].op == EDGE_SET ? up[i].w : NC;
+        c[nc].seq = i;
+        nc++;
+    }
+    qsort(c, nc, sizeof(struct edge_change), by_edge);
+    int merged = 0;
+    for (int i=0; i < nc; i++) {
+        // Within one edge, the entries are not in batch order after qsort, pick the latest one
+        if (merged > 0 && by_edge(&c[merged-1], &c[i]) == 0) {
+            if (c[i].seq > c[merged-1].seq)
+                c[merged-1] = c[i];
+        } else {
+            c[merged++] = c[i];
+        }
+    }
+    nc = merged;
+
+    // Split into increases and decreases by comparing to the current graph (both stay sorted by edge)
+    inc = malloc((nc > 0 ? nc : 1) * sizeof(struct edge_change));
+    dec = malloc((nc > 0 ? nc : 1) * sizeof(struct edge_change));
+    // Working rows: vrow/urow (rows of the decreased edge's ends), X and Y, and the affected list
+    buf = malloc(5 * (size_t)n * sizeof(int));
+    if (inc == NULL || dec == NULL || buf == NULL) {
+        printf("APSP_UPDATE: out of memory for %d nodes\n", n);
+        goto done;
+    }
+    int ninc = 0, ndec = 0;
+    for (int i=0; i < nc; i++) {
+        c[i].w_old = edge_weight(g, c[i].u, c[i].v);
+        if (c[i].w_new > c[i].w_old)
+            inc[ninc++] = c[i];
+        else if (c[i].w_new < c[i].w_old)
+            dec[ndec++] = c[i];
+    }
+    st->increases = ninc;
+    st->decreases = ndec;
+    int *vrow = buf, *urow = buf + n, *X = buf + 2*(size_t)n, *Y = buf + 3*(size_t)n, *list = buf + 4*(size_t)n;
+    int *row = s->row;
+
+    // g1 has just the increases applied, g2 everything
+    if (rebuild(g, inc, ninc, &g1) || rebuild(&g1, dec, ndec, &g2) || (ninc > 0 && csr_transpose(&g1, &rev)))
+        goto done;
+
+    // The repair gives up once it has taken UPDATE_MAX_SHARE of a full recompute, and recomputes instead
+    apsp_input_init(&in, ENGINE_AUTO, &g2, false);
+    if (apsp_scratch_prepare(&in, s))
+        goto done;
+    double budget = UPDATE_MAX_SHARE * recompute_estimate(&in, s);
+    bool give_up = false;
+
+    // Step 1: increases, on g1
+    if (ninc > 0) {
+        for (int i=0; i < n; i++)
+            s->sptSet[i] = false; // the affected flags
+        for (int x=0; x < n && !give_up; x++) {
+            // Skip rows none of the changed edges were a shortest path edge of
+            bool hit = false;
+            for (int i=0; i < ninc && !hit; i++) {
+                int du = dm_get(d, x, inc[i].u);
+                hit = du != NC && dist_add(du, inc[i].w_old) == dm_get(d, x, inc[i].v);
+            }
+            if (!hit)
+                continue;
+            dm_get_row(d, x, row);
+            int fixed = repair_row(&g1, &rev, row, inc, ninc, s->sptSet, list, s->heap);
+            if (fixed > 0)
+                dm_store_row(d, x, row);
+            st->sources_repaired++;
+            st->nodes_repaired += fixed;
+            give_up = wall_time() - t0 > budget;
+        }
+    }
+
+    // Step 2: decreases, one edge at a time (each one exact for the graph with the ones before it)
+    for (int i=0; i < ndec && !give_up; i++) {
+        int u = dec[i].u, v = dec[i].v, w = dec[i].w_new;
+        int nx = 0, ny = 0;
+        for (int x=0; x < n; x++) {
+            int du = dm_get(d, x, u);
+            if (du != NC && (long long)du + w < dm_get(d, x, v))
+                X[nx++] = x;
+        }
+        if (nx == 0)
+            continue;
+        dm_get_row(d, v, vrow);
+        dm_get_row(d, u, urow);
+        for (int y=0; y < n; y++)
+            if (vrow[y] != NC && (long long)w + vrow[y] < urow[y])
+                Y[ny++] = y;
+        for (int k=0; k < nx && !give_up; k++) {
+            dm_get_row(d, X[k], row);
+            // Fits, x was only picked because row[u] + w is below row[v]
+            int through = row[u] + w;
+            for (int j=0; j < ny; j++)
+                if (dist_add(through, vrow[Y[j]]) < row[Y[j]])
+                    row[Y[j]] = through + vrow[Y[j]];
+            dm_store_row(d, X[k], row);
+            give_up = wall_time() - t0 > budget;
+        }
+        st->rows_relaxed += nx;
+    }
+    // Every row is recomputed, so it doesn't matter where the repair stopped
+    if (give_up) {
+        if (apsp_all(&in, d, 1))
+            goto done;
+        st->recomputed = true;
+    }
+
+    csr_free(g);
+    *g = g2;
+    g2 = (struct csr_graph){0}; // g owns it now
+    rc = 0;
+done:
+    if (in.g != NULL)
+        apsp_input_free(&in);
+    csr_free(&rev);
+    csr_free(&g1);
+    csr_free(&g2);
+    free(buf);
+    free(c);
+    free(inc);
+    free(dec);
+    st->seconds = wall_time() - t0;
+    return rc;
+}
@@ -0,0 +1,59 @@
+#ifndef INCREMENTAL_H
+#define INCREMENTAL_H
+
+#include <stdbool.h>
+#include "distmat.h"
+#include "graph.h"
+#include "sssp.h"
+
+/*
+A repair that has taken this share of the estimated full recompute gives up and recomputes instead
+Big batches on sparse graphs with long paths can otherwise cost several full recomputes (every decrease
+improves most rows, every increase is on most rows' shortest paths), so the worst case is about 1.5 of one
+*/
+#define UPDATE_MAX_SHARE 0.5
+// Sources timed to estimate the full recompute
+#define UPDATE_SAMPLE_ROWS 16
+
+// What an update does to the edge u->v
+enum edge_op {
+    EDGE_SET, // insert the edge, or change its weight to w
+    EDGE_DELETE // remove the edge (w is ignored)
+};
+
+struct edge_update {
+    enum edge_op op;
+    int u, v;
+    int w; // > 0
+};
+
+// What one batch cost, to compare against a full recompute
+struct update_stats {
+    int increases; // deletes and weight increases (after merging updates to the same edge)
+    int decreases; // inserts and weight decreases
+    int sources_repaired; // rows an increase could have touched, repaired Ramalingam-Reps style
+    int64_t nodes_repaired; // nodes whose distance had to be recomputed in those rows
+    int64_t rows_relaxed; // rows a decrease improved
+    bool recomputed; // the repair went over UPDATE_MAX_SHARE of a full recompute, so d was recomputed instead
+    double seconds;
+};
+
+/*
+Applies a batch of edge updates to g and repairs the all pairs result d to match, without recomputing it
+d must hold every row and be exact for g before the call. g is replaced by the updated graph
+Updates to the same edge are merged (the last one wins), then handled in two steps:
+1: increases/deletes, on the graph with only those applied
+   A source x is affected only if some changed edge u->v was on one of its shortest paths (d[x][u] + w == d[x][v])
+   For each affected row, Ramalingam-Reps: walk the old shortest path DAG down from the changed edges in order of
+   distance, marking the nodes left with no tight in-edge from an unmarked node, then run dijkstra on just those
+2: inserts/decreases, one edge u->v at a time
+   Only sources X with d[x][u] + w < d[x][v] and targets Y with w + d[v][y] < d[u][y] can improve,
+   and for them d[x][y] = min(d[x][y], d[x][u] + w + d[v][y])
+Both steps stop once they have taken UPDATE_MAX_SHARE of what a full recompute (engine_select's engine) is
+estimated to take, and every row of d is then recomputed on the updated graph instead
+Returns 0 on success
+*/
+int apsp_update(struct csr_graph *g, struct dist_matrix *d, const struct edge_update *up, int count,
+                struct sssp_scratch *s, struct update_stats *st);
+
+#endif
@@ -0,0 +1,220 @@
+#define _GNU_SOURCE // syscall, for perf_event_open
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include "instrument.h"
+#include "timing.h"
+#ifdef APSP_PERF
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+static const char *counter_names[INSTR_COUNTERS] = {"relaxed", "updated", "scanned", "settled"};
+static const char *phase_names[INSTR_PHASES] = {"generate", "compute", "gather", "output", "min_scan", "relax"};
+static const char *hw_names[INSTR_HW] = {"cycles", "instructions", "LLC refs", "LLC misses"};
+
+// One thread's (or one named group of threads') counts, kept in a list that only ever grows
+struct instr_slot {
+    char name[32];
+    uint64_t count[INSTR_COUNTERS];
+    double seconds[INSTR_PHASES];
+    uint64_t hw[INSTR_KERNEL_PHASES][INSTR_HW];
+    struct instr_slot *next;
+};
+
+static pthread_mutex_t slots_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct instr_slot *slots = NULL;
+static int unnamed = 0;
+static __thread struct instr_slot *self = NULL;
+
+// Finds the slot called name, or adds it. A NULL name always adds a new one
+static struct instr_slot *find_slot(const char *name) {
+    pthread_mutex_lock(&slots_lock);
+    struct instr_slot **at = &slots;
+    for (; *at != NULL; at = &(*at)->next)
+        if (name != NULL && strcmp((*at)->name, name) == 0)
+            break;
+    if (*at == NULL) {
+        *at = calloc(1, sizeof(struct instr_slot));
+        if (*at == NULL) {
+            printf("INSTR: out of memory for a thread slot\n");
+            exit(-1);
+        }
+        if (name != NULL)
+            snprintf((*at)->name, sizeof((*at)->name), "%s", name);
+        else
+            snprintf((*at)->name, sizeof((*at)->name), "thread %d", unnamed++);
+    }
+    struct instr_slot *s = *at;
+    pthread_mutex_unlock(&slots_lock);
+    return s;
+}
+
+static struct instr_slot *my_slot(void) {
+    if (self == NULL)
+        self = find_slot(NULL);
+    return self;
+}
+
+void instr_thread(const char *name, int id) {
+    char full[32];
+    snprintf(full, sizeof(full), "%s %d", name, id);
+    self = find_slot(full);
+}
+
+void instr_add(enum instr_counter c, uint64_t k) {
+    my_slot()->count[c] += k;
+}
+
+#ifdef APSP_PERF
+// The calling thread's counters, opened the first time it starts an outer phase (-1 if the kernel said no)
+static __thread int perf_fd[INSTR_HW];
+static __thread int perf_state = 0; // 0 not tried yet, 1 open
+static bool perf_warned = false;
+static const uint64_t perf_config[INSTR_HW] = {
+    PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_REFERENCES, PERF_COUNT_HW_CACHE_MISSES
+};
+
+static void perf_read(uint64_t hw[INSTR_HW]) {
+    if (perf_state == 0) {
+        for (int i=0; i < INSTR_HW; i++) {
+            struct perf_event_attr attr;
+            memset(&attr, 0, sizeof(attr));
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.size = sizeof(attr);
+            attr.config = perf_config[i];
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            // This thread only, on whatever CPU it runs
+            perf_fd[i] = (int) syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+            // Said once per process, not once per thread and counter
+            pthread_mutex_lock(&slots_lock);
+            if (perf_fd[i] < 0 && !perf_warned) {
+                printf("INSTR: perf_event_open for %s failed, see /proc/sys/kernel/perf_event_paranoid\n", hw_names[i]);
+                perf_warned = true;
+            }
+            pthread_mutex_unlock(&slots_lock);
+        }
+        perf_state = 1;
+    }
+    for (int i=0; i < INSTR_HW; i++) {
+        hw[i] = 0;
+        if (perf_fd[i] >= 0 && read(perf_fd[i], &hw[i], sizeof(uint64_t)) != sizeof(uint64_t))
+            hw[i] = 0;
+    }
+}
+#endif
+
+void instr_begin(struct instr_mark *m, enum instr_phase p) {
+#ifdef APSP_PERF
+    if (p < INSTR_KERNEL_PHASES)
+        perf_read(m->hw);
+#else
+    (void) p;
+#endif
+    m->t = wall_time();
+}
+
+void instr_end(const struct instr_mark *m, enum instr_phase p) {
+    struct instr_slot *s = my_slot();
+    s->seconds[p] += wall_time() - m->t;
+#ifdef APSP_PERF
+    if (p < INSTR_KERNEL_PHASES) {
+        uint64_t now[INSTR_HW];
+        perf_read(now);
+        for (int i=0; i < INSTR_HW; i++)
+            s->hw[p][i] += now[i] - m->hw[i];
+    }
+#endif
+}
+
+// Adds one slot's counts to t, in the instr_totals layout
+static void add_slot(struct instr_totals *t, const struct instr_slot *s) {
+    double *v = t->v;
+    for (int c=0; c < INSTR_COUNTERS; c++)
+        *v++ += s->count[c];
+    for (int p=0; p < INSTR_PHASES; p++)
+        *v++ += s->seconds[p];
+    for (int p=0; p < INSTR_KERNEL_PHASES; p++)
+        for (int i=0; i < INSTR_HW; i++)
+            *v++ += s->hw[p][i];
+}
+
+void instr_totals(struct instr_totals *t) {
+    memset(t, 0, sizeof(*t));
+    pthread_mutex_lock(&slots_lock);
+    for (const struct instr_slot *s = slots; s != NULL; s = s->next)
+        add_slot(t, s);
+    pthread_mutex_unlock(&slots_lock);
+}
+
+// One line of counters and phase times, then a line per outer phase that has hardware counts
+static void print_values(const char *label, const struct instr_totals *t) {
+    const double *v = t->v;
+    printf("  %-10s", label);
+    for (int c=0; c < INSTR_COUNTERS; c++)
+        printf(" %s %.0f,", counter_names[c], v[c]);
+    v += INSTR_COUNTERS;
+    for (int p=0; p < INSTR_PHASES; p++)
+        if (v[p] > 0)
+            printf(" %s %.6f s", phase_names[p], v[p]);
+    printf("\n");
+    v += INSTR_PHASES;
+    for (int p=0; p < INSTR_KERNEL_PHASES; p++, v += INSTR_HW) {
+        if (v[HW_CYCLES] == 0 && v[HW_CACHE_REFS] == 0)
+            continue;
+        printf("    %-8s %.0f %s, %.0f %s (IPC %.2f), %.0f %s, %.0f %s (%.1f%% missed)\n", phase_names[p],
+               v[HW_CYCLES], hw_names[HW_CYCLES], v[HW_INSTRUCTIONS], hw_names[HW_INSTRUCTIONS],
+               v[HW_CYCLES] > 0 ? v[HW_INSTRUCTIONS] / v[HW_CYCLES] : 0,
+               v[HW_CACHE_REFS], hw_names[HW_CACHE_REFS], v[HW_CACHE_MISSES], hw_names[HW_CACHE_MISSES],
+               v[HW_CACHE_REFS] > 0 ? 100.0 * v[HW_CACHE_MISSES] / v[HW_CACHE_REFS] : 0);
+    }
+}
+
+void instr_report(const char *who) {
+    printf("Instrumentation%s%s:\n", who[0] ? " of " : "", who);
+    struct instr_totals total;
+    memset(&total, 0, sizeof(total));
+    double most = 0, sum = 0;
+    int computing = 0;
+    pthread_mutex_lock(&slots_lock);
+    for (const struct instr_slot *s = slots; s != NULL; s = s->next) {
+        struct instr_totals one;
+        memset(&one, 0, sizeof(one));
+        add_slot(&one, s);
+        add_slot(&total, s);
+        print_values(s->name, &one);
+        if (s->seconds[PHASE_COMPUTE] > 0) {
+            computing++;
+            sum += s->seconds[PHASE_COMPUTE];
+            most = s->seconds[PHASE_COMPUTE] > most ? s->seconds[PHASE_COMPUTE] : most;
+        }
+    }
+    pthread_mutex_unlock(&slots_lock);
+    print_values("total", &total);
+    // 1.00 means every thread computed for as long as the others, 2.00 means one took twice the average
+    if (computing > 1)
+        printf("  compute imbalance over %d threads: max / mean = %.2f\n", computing, most / (sum / computing));
+}
+
+void instr_report_ranks(const struct instr_totals *lo, const struct instr_totals *hi, const struct instr_totals *sum, int ranks) {
+    printf("Instrumentation over %d ranks (min / mean / max, imbalance = max / mean):\n", ranks);
+    for (int i=0; i < INSTR_VALUES; i++) {
+        if (hi->v[i] == 0)
+            continue;
+        char name[48];
+        if (i < INSTR_COUNTERS)
+            snprintf(name, sizeof(name), "%s", counter_names[i]);
+        else if (i < INSTR_COUNTERS + INSTR_PHASES)
+            snprintf(name, sizeof(name), "%s s", phase_names[i - INSTR_COUNTERS]);
+        else {
+            int k = i - INSTR_COUNTERS - INSTR_PHASES;
+            snprintf(name, sizeof(name), "%s %s", phase_names[k / INSTR_HW], hw_names[k % INSTR_HW]);
+        }
+        double mean = sum->v[i] / ranks;
+        printf("  %-22s %14.6g %14.6g %14.6g   %.2f\n", name, lo->v[i], mean, hi->v[i], mean > 0 ? hi->v[i] / mean : 0);
+    }
+}
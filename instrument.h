@@ -0,0 +1,92 @@
+#ifndef INSTRUMENT_H
+#define INSTRUMENT_H
+
+#include <stdint.h>
+
+/*
+Compile time instrumentation of the kernels and the programs around them
+Build with -DAPSP_STATS to turn it on, and add -DAPSP_PERF (Linux only) for hardware counters from perf_event_open
+Without APSP_STATS every macro below expands to nothing, so the kernels compile exactly as they did before
+With it, expect the dense engine to run slower: it reads the clock twice per settled node to split minDistance from relaxing
+Every thread counts into a slot of its own, so the hot paths never take a lock or an atomic,
+and the kernels count into locals that are added to the slot once per source, not once per edge
+*/
+
+enum instr_counter {
+    INSTR_RELAX, // edges looked at (for FW, min(c, a+b) evaluations)
+    INSTR_UPDATE, // relaxations that lowered a distance
+    INSTR_SCAN, // vertices looked at to pick the next one (minDistance scans, MS-BFS frontier nodes)
+    INSTR_SETTLE, // vertices whose distance became final (source/vertex pairs for MS-BFS)
+    INSTR_COUNTERS
+};
+
+enum instr_phase {
+    PHASE_GENERATE, // making, importing or mapping the graph (and splitting it into components)
+    PHASE_COMPUTE, // the all pairs kernels
+    PHASE_GATHER, // getting the rows to processor 0 (loose)
+    PHASE_OUTPUT, // writing the result file and printing
+    PHASE_MIN_SCAN, // dijkstra_one: minDistance
+    PHASE_RELAX, // dijkstra_one: the pass over the settled node's row of its dense_adj
+    INSTR_PHASES
+};
+// The phases from here on are nested in PHASE_COMPUTE and far too short to read hardware counters around
+#define INSTR_KERNEL_PHASES PHASE_MIN_SCAN
+
+enum instr_hw {
+    HW_CYCLES,
+    HW_INSTRUCTIONS,
+    HW_CACHE_REFS, // last level cache
+    HW_CACHE_MISSES,
+    INSTR_HW
+};
+
+// When (and at what hardware counts) a phase started
+struct instr_mark {
+    double t;
+    uint64_t hw[INSTR_HW];
+};
+
+/*
+Everything counted by one process (summed over its threads) flattened into doubles, so loose can MPI_Reduce it
+Laid out as the counters, then the seconds of every phase, then the hardware counts of every outer phase
+*/
+#define INSTR_VALUES (INSTR_COUNTERS + INSTR_PHASES + INSTR_KERNEL_PHASES * INSTR_HW)
+struct instr_totals {
+    double v[INSTR_VALUES];
+};
+
+/*
+Names the calling thread's slot. Threads that give the same name and id share a slot, so a pool or the
+FW threads that are made again for every run keep adding to the same line of the report
+A thread that never names itself gets a slot of its own the first time it counts something
+*/
+void instr_thread(const char *name, int id);
+void instr_add(enum instr_counter c, uint64_t k);
+void instr_begin(struct instr_mark *m, enum instr_phase p);
+void instr_end(const struct instr_mark *m, enum instr_phase p);
+
+void instr_totals(struct instr_totals *t);
+// One line per slot, then the total and how evenly compute was spread. who labels the table ("rank 3")
+void instr_report(const char *who);
+// Min, mean and max of every value over the ranks, given the MPI_MIN, MPI_MAX and MPI_SUM reductions of instr_totals
+void instr_report_ranks(const struct instr_totals *lo, const struct instr_totals *hi, const struct instr_totals *sum, int ranks);
+
+#ifdef APSP_STATS
+#define INSTR_THREAD(name, id) instr_thread(name, id)
+#define INSTR_LOCAL(var) uint64_t var = 0
+#define INSTR_INC(var, k) ((var) += (k))
+#define INSTR_ADD(c, k) instr_add(c, k)
+#define INSTR_BEGIN(mark, phase) struct instr_mark mark; instr_begin(&mark, phase)
+#define INSTR_END(mark, phase) instr_end(&mark, phase)
+#define INSTR_REPORT(who) instr_report(who)
+#else
+#define INSTR_THREAD(name, id) ((void)0)
+#define INSTR_LOCAL(var) ((void)0)
+#define INSTR_INC(var, k) ((void)0)
+#define INSTR_ADD(c, k) ((void)0)
+#define INSTR_BEGIN(mark, phase) ((void)0)
+#define INSTR_END(mark, phase) ((void)0)
+#define INSTR_REPORT(who) ((void)0)
+#endif
+
+#endif
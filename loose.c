@@ -2,100 +2,175 @@
 #include <stdio.h>
 #include <stdbool.h>
 #include <stdlib.h>
-#include <time.h>
 #include <pthread.h>
 #include <mpi.h>
+#include "apsp.h"
+#include "bench.h"
+#include "graphio.h"
+#include "instrument.h"
+#include "place.h"
+#include "pool.h"
 
-#define M_SIZE 100
-#define NC 999 // Weight for No Connection (NC): Must be > M_SIZE in practice
-
-// I wrote these prints as a proof-of-concept regarding passing a single row of the matrix to a function
-// And also to see the matrix was generated sufficiently
-void print_row(int r[], int N) {
-    // Print the values of the row
-    for (int j=0; j<N; j++)
-        printf("%d ", r[j]);
-    printf("\n");
-}
-void print_m(int m[M_SIZE][M_SIZE]) {
-    // Print matrix one row at a time
-    for (int i=0; i < M_SIZE; i++)
-        print_row(m[i],M_SIZE);
-    printf("\n");
-}
-
-// See dijkstra comments
-int minDistance(int dist[M_SIZE], bool sptSet[M_SIZE]) {
-    int min = NC, min_index;
-    for (int i = 0; i < M_SIZE; i++)
-        if (sptSet[i] == false && dist[i] <= min)
-            min = dist[i], min_index = i;
-    return min_index;
+/*
+Rows FIRST:LAST of dist computed by processor rank (out of ranks)
+Every processor (and processor 0, when collecting) works this out for itself, so nothing needs sending
+Spread evenly, so no processor has more than one row more than another
+*/
+static void row_range(int n, int ranks, int rank, int *first, int *last) {
+    *first = (int)((long)n * rank / ranks);
+    *last = (int)((long)n * (rank + 1) / ranks) - 1;
 }
 
 /*
-https://www.tutorialspoint.com/c-cplusplus-program-for-dijkstra-s-shortest-path-algorithm
-Small changes have been made from their function, including an out of bounds check and the return
-The function also assumes the matrix connections are in the rows, while the assignment says columns
-Because of this, I flipped the iterators when accessing m, hand verified to work for m_size=3,4,and 5
-This function takes in M, and a source point (0:M_SIZE-1)
-It then computes the least jumps from src to all nodes
-The distance from src->X is saved in dist[X]
+Builds the graph once per node, in an MPI-3 shared memory window
+Node rank 0 generates (or imports) it and copies it into the window, the other processors on the node just
+map the same memory, so a node holds one copy of the graph no matter how many processors it runs
+The window is laid out as off[n+1], then adj[nnz], then w[nnz] (when weighted)
+g ends up pointing into the window, so it is released with MPI_Win_free, not csr_free
+Binary graph files skip all of this: every processor mmaps the file itself, and since the mapping is
+read only the kernel backs them all with the one copy in the page cache, which is already once per node
+cfg->n (and cfg->print) are updated to match the graph on every processor
 */
-void dijkstra_one(int m[M_SIZE][M_SIZE], int src, int dist[M_SIZE]) {
-    // Bounds check
-    if (src >= M_SIZE) {
-        printf("DIJKSTRA_ONE OUT_OF_BOUNDS: %d",src);
+static void share_graph(MPI_Comm node_comm, struct run_config *cfg, struct csr_graph *g, MPI_Win *win) {
+    int node_rank;
+    MPI_Comm_rank(node_comm, &node_rank);
+    if (cfg->file != NULL && graph_file_is_binary(cfg->file)) {
+        *win = MPI_WIN_NULL;
+        if (graph_from_config(cfg, g))
+            MPI_Abort(MPI_COMM_WORLD, -1);
         return;
     }
 
-    bool sptSet[M_SIZE]; 
-    for (int i = 0; i < M_SIZE; i++) {
-        dist[i] = NC;
-        sptSet[i] = false;
+    struct csr_graph built;
+    long long sizes[4] = {0, 0, 0, 0}; // nnz, whether there are weights, n, print
+    if (node_rank == 0) {
+        if (graph_from_config(cfg, &built))
+            MPI_Abort(MPI_COMM_WORLD, -1);
+        sizes[0] = built.nnz;
+        sizes[1] = built.w != NULL;
+        sizes[2] = cfg->n;
+        sizes[3] = cfg->print;
     }
-    dist[src] = 0;
-    
-    for (int count = 0; count < M_SIZE - 1; count++) {
-        int u = minDistance(dist, sptSet);
-        sptSet[u] = true;
-        for (int j = 0; j < M_SIZE; j++) {
-            if (!sptSet[j] && m[j][u] && dist[u] != NC && (dist[u] + m[j][u]) < dist[j])
-                dist[j] = dist[u] + m[j][u];
-        }
+    MPI_Bcast(sizes, 4, MPI_LONG_LONG, 0, node_comm);
+    int64_t nnz = sizes[0];
+    bool weighted = sizes[1];
+    int n = cfg->n = (int) sizes[2];
+    cfg->print = sizes[3];
+
+    MPI_Aint bytes = (MPI_Aint)((n + 1) * sizeof(int64_t) + nnz * sizeof(int) * (weighted ? 2 : 1));
+    char *base;
+    MPI_Win_allocate_shared(node_rank == 0 ? bytes : 0, 1, MPI_INFO_NULL, node_comm, &base, win);
+    if (node_rank != 0) {
+        // Find where node rank 0's memory is mapped in this processor
+        MPI_Aint size;
+        int disp_unit;
+        MPI_Win_shared_query(*win, 0, &size, &disp_unit, &base);
     }
+    g->n = n;
+    g->nnz = nnz;
+    g->off = (int64_t *) base;
+    g->adj = (int *) (base + (n + 1) * sizeof(int64_t));
+    g->w = weighted ? g->adj + nnz : NULL;
+    g->map = NULL;
+    g->map_len = 0;
+
+    MPI_Win_fence(0, *win);
+    if (node_rank == 0) {
+        memcpy(g->off, built.off, (n + 1) * sizeof(int64_t));
+        memcpy(g->adj, built.adj, nnz * sizeof(int));
+        if (weighted)
+            memcpy(g->w, built.w, nnz * sizeof(int));
+        csr_free(&built);
+    }
+    // Nobody reads the graph until node rank 0 is done writing it
+    MPI_Win_fence(0, *win);
 }
 
-int main() {
-    // Track the runtime of the program (measures CPU time, NOT wall time, which is desired)
-    // Learned from https://stackoverflow.com/questions/5248915/execution-time-of-c-program
-    // After completing all 3 parts, I am not sure the accuracy of this when threading is involved,
-    // as the results shown by this clock are much larger than the wall time the crc provides
-    clock_t begin = clock();
+/*
+-g stream messages are whole rows, one element of row_t[width] each, like the gather's row_t
+A width can change mid stream, so there is one type per width (1, 2 and 4, the other entries are unused)
+Counts are then rows, not bytes, and stay in range of an int however big n and the chunks get
+*/
+static void row_types_create(int n, MPI_Datatype row_t[5]) {
+    for (int width = 1; width <= 4; width *= 2) {
+        MPI_Type_contiguous(n * width, MPI_BYTE, &row_t[width]);
+        MPI_Type_commit(&row_t[width]);
+    }
+}
 
-    // Set the seed so the matrix M is deterministic
-    // In "real life", this identical matrix could be recieved by all files via some
-    // external source, such as a file, network, or other shared resource
-    // Alternatively, the main world could create the matrix and share it with all other nodes,
-    // I am opting not to do that since it seems like it is not the intention of this project
-    // For this project, I will simply have each thread create identical (arbitray) matrices
-    srand(0);
+static void row_types_free(MPI_Datatype row_t[5]) {
+    for (int width = 1; width <= 4; width *= 2)
+        MPI_Type_free(&row_t[width]);
+}
 
-    // Create the matrix of relationships
-    // Randomly set every connection to 0 or 1 with SPLIT = % of connections (to adjust sparcity)
-    int split = 5;
-    int (*m)[M_SIZE] = malloc(sizeof(int[M_SIZE][M_SIZE]));
-    for (int i=0; i < M_SIZE; i++) {
-        for (int j=0; j < M_SIZE; j++) {
-            m[i][j] = rand()%100 < split;
-        }
-        // Set all diagonals to 1
-        // (Likely unecessary, but may cause unplanned issues and is logical to me anyway)
-        m[i][i] = 1;
+/*
+Processor 0's side of -g stream: stores every chunk that has arrived (waiting for one first when wait is set)
+Each sender sends at whatever width its dist had reached, and tags the chunk with that width,
+so the chunk is received into buf and converted into this processor's dist
+next_row[i] is the next row expected from processor i, messages from one sender arrive in order
+Returns the number of rows stored
+*/
+static int receive_chunks(struct dist_matrix *dist, int *next_row, void *buf, MPI_Datatype row_t[5], bool wait) {
+    int got = 0;
+    for (;;) {
+        MPI_Status status;
+        int ready = 1;
+        if (wait && got == 0)
+            MPI_Probe(MPI_ANY_SOURCE, MPI_ANY_TAG, MPI_COMM_WORLD, &status);
+        else
+            MPI_Iprobe(MPI_ANY_SOURCE, MPI_ANY_TAG, MPI_COMM_WORLD, &ready, &status);
+        if (!ready)
+            return got;
+        int rows, width = status.MPI_TAG, from = status.MPI_SOURCE;
+        MPI_Get_count(&status, row_t[width], &rows);
+        MPI_Recv(buf, rows, row_t[width], from, width, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+        dm_store_packed(dist, next_row[from], rows, buf, width);
+        next_row[from] += rows;
+        got += rows;
+    }
+}
+
+/*
+Placement (-P): the NUMA node of the worker that starts out with each of this processor's rows start:end, for dm_place
+The pool splits them the way the runs below do: all at once, or wave rows at a time when streaming (wave > 0)
+Rows held for the other processors (processor 0 collecting) are left to wherever they are first received
+*/
+static int *row_nodes(const struct place_plan *plan, const struct thread_pool *pool, const struct dist_matrix *dist,
+                      int start, int end, int chunk, int wave) {
+    int *node = malloc((dist->rows > 0 ? dist->rows : 1) * sizeof(int));
+    if (node == NULL) {
+        printf("Not enough memory to place %d rows\n", dist->rows);
+        MPI_Abort(MPI_COMM_WORLD, -1);
     }
+    for (int i = 0; i < dist->rows; i++)
+        node[i] = -1;
+    for (int r = start; r <= end; r++) {
+        int lo = wave > 0 ? start + (r - start) / wave * wave : start;
+        int hi = wave > 0 && lo + wave - 1 < end ? lo + wave - 1 : end;
+        node[r - dist->first] = plan->node[pool_owner(pool, lo, hi, chunk, r)];
+    }
+    return node;
+}
+
+int main(int argc, char *argv[]) {
+    // Size, density and seed used to be compile time constants, now they come from the command line
+    struct run_config cfg;
+    if (parse_args(argc, argv, &cfg))
+        exit(-1);
 
     // Initialize the MPI environment
-    MPI_Init(NULL, NULL);
+    // FUNNELED is enough for the hybrid mode: the pool threads only compute, every MPI call is made from main
+    int provided;
+    MPI_Init_thread(NULL, NULL, MPI_THREAD_FUNNELED, &provided);
+    if (provided < MPI_THREAD_FUNNELED) {
+        printf("MPI only provides thread level %d, the pool threads need MPI_THREAD_FUNNELED\n", provided);
+        MPI_Abort(MPI_COMM_WORLD, -1);
+    }
+    // Track the runtime of the program
+    // This used to be clock() from before MPI_Init, which is CPU time summed over the threads, not the wall
+    // time the crc reports. Now it is MPI_Wtime, and the all pairs runs are timed on their own (see bench.h)
+    double begin = MPI_Wtime();
+    INSTR_THREAD("main", 0);
     // Get the number of processes
     int world_size;
     MPI_Comm_size(MPI_COMM_WORLD, &world_size);
@@ -106,86 +181,351 @@ int main() {
     char processor_name[MPI_MAX_PROCESSOR_NAME];
     int name_len;
     MPI_Get_processor_name(processor_name, &name_len);
+    // The processors that share this node's memory
+    MPI_Comm node_comm;
+    MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, world_rank, MPI_INFO_NULL, &node_comm);
+    int node_rank, node_size;
+    MPI_Comm_rank(node_comm, &node_rank);
+    MPI_Comm_size(node_comm, &node_size);
+
+    // Set the seed so the matrix M is deterministic
+    // In "real life", this identical matrix could be recieved by all files via some
+    // external source, such as a file, network, or other shared resource
+    // It used to be created (identically) by every processor, so a node running one processor per core
+    // held one copy of the graph per core. Now one processor per node creates it in shared memory
+    // and the rest of the node reads that same copy (see share_graph)
+
+    // Create the graph of relationships
+    // Randomly set every connection to 0 or 1 with SPLIT = % of connections (to adjust sparcity)
+    // Generated straight into CSR so memory scales with the edges, not n^2
+    // Or, with -f, read from a graph file, so the graph really does come from an external source
+    INSTR_BEGIN(generate, PHASE_GENERATE);
+    struct csr_graph g;
+    MPI_Win graph_win;
+    share_graph(node_comm, &cfg, &g, &graph_win);
+    int n = cfg.n;
+    // Dense copy is only made for printing, the dense engine builds its own layout (see dense_adj)
+    int (*m)[n] = NULL;
+    if (cfg.print) {
+        m = malloc(sizeof(int[n][n]));
+        if (m == NULL) {
+            printf("Not enough memory for a dense %d x %d matrix\n", n, n);
+            MPI_Abort(MPI_COMM_WORLD, -1);
+        }
+        csr_to_dense(&g, &(m[0][0]));
+    }
+    INSTR_END(generate, PHASE_GENERATE);
+
+    // Hybrid mode: every processor spreads its rows over a pool of threads
+    // By default the cores of a node are split evenly between the processors on it,
+    // so one processor per node gets every core and one processor per core gets one thread (the old behavior)
+    int nthreads = cfg.threads;
+    if (nthreads <= 0) {
+        nthreads = pool_default_threads() / node_size;
+        if (nthreads < 1)
+            nthreads = 1;
+    }
 
     int start, end; // FIRST and LAST node to calculate SP weights for
     // Use world_rank to determine role in computations
-    start = (M_SIZE / world_size) * world_rank;
-    end = (M_SIZE / world_size) * (world_rank + 1) - 1;
-    // Last node computes a the remainder in case M_SIZE not evenly divisible by WORLD_SIZE
-    if (world_rank == world_size - 1)
-        end = M_SIZE - 1;
+    row_range(n, world_size, world_rank, &start, &end);
+    int my_rows = end - start + 1;
 
     // Print a message to signal node is running
-    printf("Processor %s, rank %d / %d: start = %d, end = %d\n", processor_name, world_rank, world_size, start, end);
-
-    // Run dijkstras on this processors portion of the nodes
-    // Store the results into appropriate rows of a local dist matrix
-    // Memory could be saved by only creating dist to be [end-start][M_SIZE], but I chose
-    // to make dist the full size so that it is 1: known at compile time, 2: the same size for all processors
-    // Point 2 will come in handy when MPI_SEND/RECV are called on the entire contiguous memory location at once
-    int (*dist)[M_SIZE] = malloc(sizeof(int[M_SIZE][M_SIZE]));
-    for (int i=start; i<=end; i++)
-        dijkstra_one(m,i,dist[i]);
-    
-    // Share data with processor 0
-    // Code to send MxM matrix at once from https://stackoverflow.com/questions/5901476/sending-and-receiving-2d-array-over-mpi
-    // This works since I created dist as a contiguous memory block with M_SIZE * M_SIZE elements
-    if (world_rank != 0) {
-        printf("Proc: %d sending dist\n", world_rank);
-        MPI_Send(&(dist[0][0]), M_SIZE*M_SIZE, MPI_INT, 0, 0, MPI_COMM_WORLD);
-    } else {
-        // This is PROC_0 and is responsible for assembling / combining all results together
-        // Create buffer for results to be recieved into
-        // Again, proc_dist being the same size for all processors is coming in handy here
-        // The same buffer can be reused for all recieves and then ultimately freed
-        int (*proc_dist)[M_SIZE] = malloc(sizeof(int[M_SIZE][M_SIZE]));
-        for (int i = 1; i < world_size; i++) {
-            // Await distance matrix results from PROC_i
-            MPI_Recv(&(proc_dist[0][0]), M_SIZE*M_SIZE, MPI_INT, i, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-
-            // Use world_rank to determine role in computations
-            // I could have had each processor send their start and end data with MPI_SEND
-            // I opted not to, since the overhead seemed like it would not be worth when
-            // compared to 3 simple arithmetic operations
-            int proc_start = (M_SIZE / world_size) * i;
-            int proc_end = (M_SIZE / world_size) * (i + 1) - 1;
-            if (i == world_size - 1)
-                proc_end = M_SIZE - 1;
-
-            // Combine relevant rows into main dist matrix
-            // We know that the results of a PROC_i saved their results
-            // into the rows of dist from dist[start] : dist[end]
-            // I loop through each of these rows and copy the contiguos memory
-            // into the main dist matrix stored in proc_0
-            // I *could* have done this in 1 line with something like
-            // memcpy(dist[r], proc_dist[r], sizeof(int[M_SIZE][proc_end-proc_start]));
-            // but that seems very sketchy to me
-            for (int r=proc_start; r <= proc_end; r++)
-                memcpy(dist[r], proc_dist[r], sizeof(int[M_SIZE]));
+    printf("Processor %s, rank %d / %d (node rank %d / %d, %d threads): start = %d, end = %d\n",
+           processor_name, world_rank, world_size, node_rank, node_size, nthreads, start, end);
+
+    struct apsp_input in;
+    apsp_input_init(&in, cfg.engine, &g, false);
+    if (world_rank == 0)
+        printf("Engine: %s\n", engine_name(in.engine));
+    if (cfg.components)
+        apsp_input_components(&in);
+    struct thread_pool *pool = pool_create(nthreads);
+    if (pool == NULL)
+        MPI_Abort(MPI_COMM_WORLD, -1);
+    struct sssp_scratch **scratch = malloc(nthreads * sizeof(struct sssp_scratch *));
+    if (scratch == NULL) {
+        printf("Not enough memory for %d threads\n", nthreads);
+        MPI_Abort(MPI_COMM_WORLD, -1);
+    }
+    for (int t = 0; t < nthreads; t++) {
+        if ((scratch[t] = apsp_scratch_create(&in)) == NULL) {
+            printf("Not enough memory for the scratch of thread %d (%d nodes)\n", t, n);
+            MPI_Abort(MPI_COMM_WORLD, -1);
         }
-        // Our trusty buffer can now be freed
-        // since all messages are completed
-        free(proc_dist);
-
-        // Proc_0 prints the matrix (for debugging)
-        if (world_rank == 0) {
-            // Printing will be interrupted by other processor prints, and is not necessary outside testing
-            // But it is sufficient enough to determine accuracy/functionality
-            if (M_SIZE <= 100) {
-                printf("M = \n");
-                print_m(m);
-                printf("dist = \n");
-                print_m(dist);
+    }
+
+    // Every processor used to allocate (and send) a full n*n dist, even though it only filled its own rows
+    // Now only processor 0 holds the full matrix (and only when collecting), everyone else holds exactly
+    // their rows. Either way it starts at a byte per entry and only widens if it has to (see distmat.h)
+    // With -o there is nothing to collect: every processor writes its own rows straight into the one result file
+    struct dist_matrix dist;
+    int rc;
+    if (cfg.out)
+        rc = dm_init(&dist, start, 0, n);
+    else if (world_rank == 0 && cfg.collect != COLLECT_NONE)
+        rc = dm_init(&dist, 0, n, n);
+    else
+        rc = dm_init(&dist, start, my_rows, n);
+    if (rc) {
+        printf("Not enough memory for the dist rows on rank %d\n", world_rank);
+        MPI_Abort(MPI_COMM_WORLD, -1);
+    }
+
+    // With -P every thread is pinned, and the rows this processor computes go on the node of the thread computing them
+    // When the launcher already gave each processor its own cores they are used as they are, otherwise
+    // the processors on a node count their threads' cores one after the other
+    struct numa_topology topo;
+    struct place_plan plan;
+    if (topo_detect(&topo))
+        MPI_Abort(MPI_COMM_WORLD, -1);
+    int slot = topo.ncpus < topo.online ? 0 : node_rank * nthreads;
+    if (place_threads(&plan, &topo, cfg.place, pool, slot))
+        MPI_Abort(MPI_COMM_WORLD, -1);
+    int *row_node = NULL;
+    if (cfg.place != PLACE_NONE) {
+        if (!cfg.out) {
+            bool stream = cfg.collect == COLLECT_STREAM;
+            int chunk = cfg.chunk > 0 ? cfg.chunk : apsp_default_chunk(&in, stream ? n / world_size : my_rows, nthreads);
+            row_node = row_nodes(&plan, pool, &dist, start, end, chunk, stream ? chunk * nthreads : 0);
+            dm_place(&dist, &plan, row_node);
+        }
+        // The graph window is shared by the processors of the node, so only the one that wrote it moves it
+        if (place_graph(&plan, node_rank == 0 ? &g : NULL, &in.dense))
+            printf("Could not interleave the graph over the NUMA nodes\n");
+    }
+
+    // Every thread of this processor writes its chunks into its rows of dist
+    struct apsp_job job;
+    job.d = &dist;
+    job.out = NULL;
+    job.in = &in;
+    job.scratch = scratch;
+    // Each processor owns a range of rows, so they have to run as a range
+    job.by_component = false;
+
+    // Each run starts together and lasts until the slowest processor is done with it
+    struct bench b;
+    if (bench_init(&b, "loose", &cfg))
+        MPI_Abort(MPI_COMM_WORLD, -1);
+    int file_width = 0; // what the result file ends up at (-o)
+    for (int run = 0; run < cfg.warmup + cfg.reps; run++) {
+        MPI_Barrier(MPI_COMM_WORLD);
+        double t0 = MPI_Wtime();
+        if (cfg.out) {
+            // Processor 0 creates and sizes the file, then everyone writes their rows at their final offsets
+            // (on a shared file system every node writes its part in parallel, nothing goes through processor 0)
+            int width = result_file_width(&g);
+            if (world_rank == 0 && result_file_prepare(cfg.out, n, width))
+                MPI_Abort(MPI_COMM_WORLD, -1);
+            MPI_Barrier(MPI_COMM_WORLD);
+            int chunk = cfg.chunk > 0 ? cfg.chunk : apsp_default_chunk(&in, my_rows, nthreads);
+            job.out = result_file_open(cfg.out, n, width, chunk, 2 * nthreads);
+            if (job.out == NULL)
+                MPI_Abort(MPI_COMM_WORLD, -1);
+            pool_run(pool, start, end, chunk, dijkstra_some, &job);
+            int used;
+            if (result_file_close(job.out, &used))
+                MPI_Abort(MPI_COMM_WORLD, -1);
+            // Every row is on disk once everyone is past here, then processor 0 narrows the file to what they all needed
+            MPI_Allreduce(&used, &file_width, 1, MPI_INT, MPI_MAX, MPI_COMM_WORLD);
+            if (world_rank == 0 && result_file_narrow(cfg.out, file_width))
+                MPI_Abort(MPI_COMM_WORLD, -1);
+            MPI_Barrier(MPI_COMM_WORLD);
+        } else if (cfg.collect == COLLECT_STREAM) {
+            // Same chunk size on every processor, so processor 0 knows how every message is cut up
+            int chunk = cfg.chunk > 0 ? cfg.chunk : apsp_default_chunk(&in, n / world_size, nthreads);
+            // The threads work a wave of one chunk each at a time, then main deals with MPI before the next one
+            int wave = chunk * nthreads;
+            MPI_Datatype row_t[5];
+            row_types_create(n, row_t);
+            if (world_rank == 0) {
+                // Store every other processor's chunks as they arrive, in between waves of its own rows
+                int *next_row = malloc(world_size * sizeof(int));
+                void *buf = malloc((size_t)chunk * n * sizeof(int));
+                if (next_row == NULL || buf == NULL) {
+                    printf("Not enough memory to receive chunks of %d rows\n", chunk);
+                    MPI_Abort(MPI_COMM_WORLD, -1);
+                }
+                for (int i = 0; i < world_size; i++) {
+                    int proc_end;
+                    row_range(n, world_size, i, &next_row[i], &proc_end);
+                }
+                int expected = n - my_rows;
+                for (int w = start; w <= end; w += wave) {
+                    int wave_end = w + wave - 1 < end ? w + wave - 1 : end;
+                    pool_run(pool, w, wave_end, chunk, dijkstra_some, &job);
+                    INSTR_BEGIN(gather, PHASE_GATHER);
+                    expected -= receive_chunks(&dist, next_row, buf, row_t, false);
+                    INSTR_END(gather, PHASE_GATHER);
+                }
+                INSTR_BEGIN(gather, PHASE_GATHER);
+                while (expected > 0)
+                    expected -= receive_chunks(&dist, next_row, buf, row_t, true);
+                INSTR_END(gather, PHASE_GATHER);
+                free(buf);
+                free(next_row);
+            } else {
+                // Ship each chunk as soon as it is done, the network moves it while the next ones compute
+                // The sends read straight out of dist, so if the threads widen it mid stream the old rows stay alive
+                dist.keep_old = true;
+                MPI_Request *reqs = malloc(sizeof(MPI_Request) * ((size_t)my_rows / chunk + 1));
+                if (reqs == NULL) {
+                    printf("Not enough memory for %d sends\n", my_rows / chunk + 1);
+                    MPI_Abort(MPI_COMM_WORLD, -1);
+                }
+                int nreq = 0;
+                for (int w = start; w <= end; w += wave) {
+                    int wave_end = w + wave - 1 < end ? w + wave - 1 : end;
+                    pool_run(pool, w, wave_end, chunk, dijkstra_some, &job);
+                    INSTR_BEGIN(gather, PHASE_GATHER);
+                    for (int r = w; r <= wave_end; r += chunk) {
+                        int rows = wave_end - r + 1 < chunk ? wave_end - r + 1 : chunk;
+                        MPI_Isend(dm_row(&dist, r), rows, row_t[dist.width], 0, dist.width, MPI_COMM_WORLD, &reqs[nreq++]);
+                    }
+                    INSTR_END(gather, PHASE_GATHER);
+                }
+                INSTR_BEGIN(gather, PHASE_GATHER);
+                MPI_Waitall(nreq, reqs, MPI_STATUSES_IGNORE);
+                INSTR_END(gather, PHASE_GATHER);
+                free(reqs);
+            }
+            row_types_free(row_t);
+        } else {
+            // Run dijkstras on this processors portion of the nodes, spread over its threads
+            int chunk = cfg.chunk > 0 ? cfg.chunk : apsp_default_chunk(&in, my_rows, nthreads);
+            pool_run(pool, start, end, chunk, dijkstra_some, &job);
+
+            if (cfg.collect == COLLECT_GATHER) {
+                INSTR_BEGIN(gather, PHASE_GATHER);
+                // Everyone agrees on the widest width any processor needed, and widens to it
+                int width = dist.width;
+                MPI_Allreduce(MPI_IN_PLACE, &width, 1, MPI_INT, MPI_MAX, MPI_COMM_WORLD);
+                dm_widen(&dist, width);
+
+                // A whole row of dist is one element of row_t, so counts stay small (and in range of an int)
+                // even when n*n doesn't fit in one
+                MPI_Datatype row_t;
+                MPI_Type_contiguous(n * width, MPI_BYTE, &row_t);
+                MPI_Type_commit(&row_t);
+
+                // Processor 0 could work out everyone's start and end from world_size, so it does, instead of
+                // each processor sending them. Its own rows are already in place in dist (MPI_IN_PLACE)
+                int *counts = malloc(world_size * sizeof(int));
+                int *displs = malloc(world_size * sizeof(int));
+                if (counts == NULL || displs == NULL) {
+                    printf("Not enough memory to gather from %d processors\n", world_size);
+                    MPI_Abort(MPI_COMM_WORLD, -1);
+                }
+                for (int i = 0; i < world_size; i++) {
+                    int proc_start, proc_end;
+                    row_range(n, world_size, i, &proc_start, &proc_end);
+                    counts[i] = proc_end - proc_start + 1;
+                    displs[i] = proc_start;
+                }
+                if (world_rank == 0)
+                    MPI_Gatherv(MPI_IN_PLACE, 0, row_t, dist.data, counts, displs, row_t, 0, MPI_COMM_WORLD);
+                else
+                    MPI_Gatherv(dist.data, my_rows, row_t, NULL, NULL, NULL, row_t, 0, MPI_COMM_WORLD);
+                free(counts);
+                free(displs);
+                MPI_Type_free(&row_t);
+                INSTR_END(gather, PHASE_GATHER);
             }
         }
+        double took = MPI_Wtime() - t0, slowest;
+        MPI_Reduce(&took, &slowest, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+        if (world_rank == 0)
+            bench_add(&b, slowest);
+    }
+    if (nthreads > 1)
+        pool_report(pool);
+    for (int t = 0; t < nthreads; t++)
+        scratch_free(scratch[t]);
+    free(scratch);
+    pool_destroy(pool);
+
+    if (cfg.check) {
+        // Processor 0 checks everything it collected (or the file), with -g none everyone checks their own rows
+        long long wrong = 0, total;
+        if (world_rank == 0 && cfg.out)
+            wrong = bench_check_file(&g, in.engine, cfg.out);
+        else if (world_rank == 0 || (cfg.collect == COLLECT_NONE && !cfg.out))
+            wrong = bench_check(&g, in.engine, &dist);
+        MPI_Reduce(&wrong, &total, 1, MPI_LONG_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+        b.wrong = wrong < 0 ? -1 : total;
+    }
+    if (world_rank == 0) {
+        bench_report(&b);
+        if (cfg.check)
+            bench_check_report(&g, in.engine, b.wrong);
+        b.engine = engine_name(in.engine);
+        b.threads = nthreads;
+        b.ranks = world_size;
+        b.width = cfg.out ? file_width : dist.width;
+        if (cfg.bench && bench_record(cfg.bench, &b, &cfg, &g))
+            MPI_Abort(MPI_COMM_WORLD, -1);
+    }
+    bench_free(&b);
+
+    if (world_rank == 0 && cfg.out)
+        printf("Distances written to %s\n", cfg.out);
+    else if (world_rank == 0)
+        printf("Distances stored in %d byte(s) each\n", dist.width);
+
+    // Proc_0 prints the matrix (for debugging)
+    INSTR_BEGIN(output, PHASE_OUTPUT);
+    if (world_rank == 0 && cfg.print) {
+        // Printing will be interrupted by other processor prints, and is not necessary outside testing
+        // But it is sufficient enough to determine accuracy/functionality
+        printf("M = \n");
+        print_m(n, &(m[0][0]));
+        if (cfg.out) {
+            printf("dist = \n");
+            result_file_print(cfg.out);
+        } else {
+            if (cfg.collect == COLLECT_NONE)
+                printf("dist stays distributed (-g none), rows %d : %d of it = \n", start, end);
+            else
+                printf("dist = \n");
+            dm_print(&dist);
+        }
     }
+    INSTR_END(output, PHASE_OUTPUT);
 
-    // Equation to get runtime in seconds, see earlier comment for source
-    clock_t stop = clock();
-    double run_time = (double)(stop - begin) / CLOCKS_PER_SEC;
+#ifdef APSP_STATS
+    // Every rank's own threads, then how the ranks compare (an imbalance well over 1 is a rank holding the others up)
+    char who[32];
+    snprintf(who, sizeof(who), "rank %d", world_rank);
+    instr_report(who);
+    struct instr_totals mine, lo, hi, sum;
+    instr_totals(&mine);
+    MPI_Reduce(mine.v, lo.v, INSTR_VALUES, MPI_DOUBLE, MPI_MIN, 0, MPI_COMM_WORLD);
+    MPI_Reduce(mine.v, hi.v, INSTR_VALUES, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+    MPI_Reduce(mine.v, sum.v, INSTR_VALUES, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
+    if (world_rank == 0)
+        instr_report_ranks(&lo, &hi, &sum, world_size);
+#endif
+
+    double run_time = MPI_Wtime() - begin;
     // Display results
     printf("\nProgram runtime: %f\n", run_time);
 
+    free(m);
+    dm_free(&dist);
+    free(row_node);
+    place_free(&plan);
+    topo_free(&topo);
+    apsp_input_free(&in);
+    // g points into the shared window, so it goes away with the window instead of csr_free
+    // (unless it was mapped from a binary file)
+    if (graph_win != MPI_WIN_NULL)
+        MPI_Win_free(&graph_win);
+    else
+        csr_free(&g);
+    MPI_Comm_free(&node_comm);
+
     // Finalize the MPI environment.
     MPI_Finalize();
 }
\ No newline at end of file
@@ -0,0 +1,249 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "apsp.h"
+#include "oracle.h"
+#include "timing.h"
+
+// Everything the pool task needs to compute landmark rows
+struct oracle_job {
+    struct landmark_oracle *o;
+    const struct apsp_input *in[2]; // searches from a landmark on g, and to it (from it on rev)
+    struct sssp_scratch **scratch; // one per pool thread
+};
+
+// pool_task over items lo:hi, item 2i is the row from landmark i and item 2i+1 the row to it
+static void oracle_rows(void *job, int worker, int lo, int hi) {
+    struct oracle_job *j = (struct oracle_job *) job;
+    struct sssp_scratch *s = j->scratch[worker];
+    for (int item=lo; item <= hi; item++) {
+        int i = item / 2, dir = item % 2;
+        apsp_row(j->in[dir], j->o->landmarks[i], s);
+        dm_store_row(dir ? &j->o->to : &j->o->from, i, s->row);
+    }
+}
+
+struct by_degree {
+    int64_t degree;
+    int v;
+};
+
+// Most edges first, lowest node first among equals so the pick doesn't depend on qsort
+static int most_edges(const void *a, const void *b) {
+    const struct by_degree *x = a, *y = b;
+    if (x->degree != y->degree)
+        return x->degree > y->degree ? -1 : 1;
+    return (x->v > y->v) - (x->v < y->v);
+}
+
+int oracle_build(struct landmark_oracle *o, const struct csr_graph *g, enum engine e, int k,
+                 enum landmark_select select, struct thread_pool *pool) {
+    double t0 = wall_time();
+    int n = g->n;
+    o->n = n;
+    o->k = k = k < n ? k : n;
+    o->g = g;
+    o->landmarks = malloc(k * sizeof(int));
+    int64_t *degree = malloc(n * sizeof(int64_t));
+    if (o->landmarks == NULL || degree == NULL || csr_transpose(g, &o->rev) ||
+        dm_init(&o->from, 0, k, n) || dm_init(&o->to, 0, k, n)) {
+        printf("ORACLE_BUILD: not enough memory for %d landmarks on %d nodes\n", k, n);
+        free(degree);
+        return -1;
+    }
+    for (int v=0; v < n; v++)
+        degree[v] = (g->off[v+1] - g->off[v]) + (o->rev.off[v+1] - o->rev.off[v]);
+
+    // One search per row, so the engines that only do whole batches (bfs) or matrices (fw) are swapped for the heap
+    if (e == ENGINE_AUTO)
+        e = engine_select(g, false);
+    if (e == ENGINE_BFS || e == ENGINE_FW)
+        e = ENGINE_HEAP;
+    struct apsp_input fwd, bwd;
+    apsp_input_init(&fwd, e, g, false);
+    apsp_input_init(&bwd, e, &o->rev, false);
+    struct oracle_job job = {o, {&fwd, &bwd}, malloc(pool->nthreads * sizeof(struct sssp_scratch *))};
+    if (job.scratch == NULL) {
+        printf("ORACLE_BUILD: out of memory for %d threads\n", pool->nthreads);
+        exit(-1);
+    }
+    for (int t=0; t < pool->nthreads; t++)
+        if ((job.scratch[t] = apsp_scratch_create(&fwd)) == NULL || apsp_scratch_prepare(&bwd, job.scratch[t]))
+            exit(-1);
+
+    if (select == LANDMARK_DEGREE) {
+        struct by_degree *order = malloc(n * sizeof(struct by_degree));
+        if (order == NULL) {
+            printf("ORACLE_BUILD: out of memory for %d nodes\n", n);
+            exit(-1);
+        }
+        for (int v=0; v < n; v++) {
+            order[v].degree = degree[v];
+            order[v].v = v;
+        }
+        qsort(order, n, sizeof(struct by_degree), most_edges);
+        for (int i=0; i < k; i++)
+            o->landmarks[i] = order[i].v;
+        free(order);
+        pool_run(pool, 0, 2*k - 1, 1, oracle_rows, &job);
+    } else {
+        // closest[v] is how near v is to any landmark so far, either way. The next landmark is the v it is largest for
+        int *closest = malloc(n * sizeof(int));
+        bool *taken = calloc(n, sizeof(bool));
+        if (closest == NULL || taken == NULL) {
+            printf("ORACLE_BUILD: out of memory for %d nodes\n", n);
+            exit(-1);
+        }
+        for (int v=0; v < n; v++)
+            closest[v] = NC;
+        for (int i=0; i < k; i++) {
+            // The first pick is just the node with the most edges, every node is equally far from no landmarks
+            int pick = -1;
+            for (int v=0; v < n; v++)
+                if (!taken[v] && (pick < 0 || closest[v] > closest[pick] ||
+                                  (closest[v] == closest[pick] && degree[v] > degree[pick])))
+                    pick = v;
+            taken[pick] = true;
+            o->landmarks[i] = pick;
+            pool_run(pool, 2*i, 2*i + 1, 1, oracle_rows, &job);
+            for (int v=0; v < n; v++) {
+                int near = dm_get(&o->from, i, v), back = dm_get(&o->to, i, v);
+                near = back < near ? back : near;
+                if (near < closest[v])
+                    closest[v] = near;
+            }
+        }
+        free(closest);
+        free(taken);
+    }
+
+    for (int t=0; t < pool->nthreads; t++)
+        scratch_free(job.scratch[t]);
+    free(job.scratch);
+    apsp_input_free(&fwd);
+    apsp_input_free(&bwd);
+    free(degree);
+    o->seconds = wall_time() - t0;
+    return 0;
+}
+
+void oracle_free(struct landmark_oracle *o) {
+    free(o->landmarks);
+    dm_free(&o->from);
+    dm_free(&o->to);
+    csr_free(&o->rev);
+}
+
+void oracle_bounds(const struct landmark_oracle *o, int s, int t, int *lower, int *upper) {
+    *lower = *upper = 0;
+    if (s == t)
+        return;
+    long long lo = 0, up = NC;
+    for (int i=0; i < o->k; i++) {
+        int ls = dm_get(&o->from, i, s), lt = dm_get(&o->from, i, t);
+        int sl = dm_get(&o->to, i, s), tl = dm_get(&o->to, i, t);
+        // L -> s -> t would reach t, and s -> t -> L would reach L
+        if ((ls != NC && lt == NC) || (tl != NC && sl == NC)) {
+            *lower = *upper = NC;
+            return;
+        }
+        if (sl != NC && lt != NC && (long long)sl + lt < up)
+            up = (long long)sl + lt;
+        if (ls != NC && lt - ls > lo)
+            lo = lt - ls;
+        if (tl != NC && sl - tl > lo)
+            lo = sl - tl;
+    }
+    *lower = (int)lo;
+    *upper = (int)up;
+}
+
+int oracle_exact(const struct landmark_oracle *o, int s, int t, struct query_scratch *qs) {
+    int lower, upper;
+    oracle_bounds(o, s, t, &lower, &upper);
+    if (lower == upper)
+        return upper;
+    return query_pair_bounded(o->g, &o->rev, s, t, upper, qs);
+}
+
+// Everything the pool task needs for one batch of oracle queries
+struct oracle_query_job {
+    const struct landmark_oracle *o;
+    struct sp_query *q;
+    bool refine;
+    struct query_scratch **qs;
+};
+
+// pool_task over queries lo:hi
+static void oracle_some(void *job, int worker, int lo, int hi) {
+    struct oracle_query_job *j = (struct oracle_query_job *) job;
+    for (int i=lo; i <= hi; i++) {
+        struct sp_query *q = &j->q[i];
+        double t0 = wall_time();
+        if (j->refine) {
+            q->dist = oracle_exact(j->o, q->src, q->dst, j->qs[worker]);
+        } else {
+            int lower;
+            oracle_bounds(j->o, q->src, q->dst, &lower, &q->dist);
+        }
+        q->latency = wall_time() - t0;
+    }
+}
+
+int oracle_batch(const struct landmark_oracle *o, struct sp_query *q, int count, bool refine,
+                 struct query_scratch **qs, struct thread_pool *pool, struct query_stats *st) {
+    st->queries = count;
+    st->groups = 0;
+    st->wall = st->p50 = st->p99 = st->max = 0;
+    if (count <= 0)
+        return 0;
+    for (int i=0; i < count; i++) {
+        if (q[i].src < 0 || q[i].src >= o->n || q[i].dst < 0 || q[i].dst >= o->n) {
+            printf("ORACLE_BATCH: query %d -> %d is out of bounds\n", q[i].src, q[i].dst);
+            return -1;
+        }
+    }
+    double t0 = wall_time();
+    // An estimate is a few dozen loads, so they go out in big chunks. Exact ones vary a lot, and get small ones
+    int chunk = count / (pool->nthreads * (refine ? 64 : 4));
+    struct oracle_query_job job = {o, q, refine, qs};
+    pool_run(pool, 0, count - 1, chunk > 0 ? chunk : 1, oracle_some, &job);
+    st->wall = wall_time() - t0;
+    // Only the exact queries whose bounds didn't meet had to search
+    if (refine)
+        for (int i=0; i < count; i++) {
+            int lower, upper;
+            oracle_bounds(o, q[i].src, q[i].dst, &lower, &upper);
+            st->groups += lower != upper;
+        }
+    return query_latencies(q, count, st);
+}
+
+void oracle_report_error(const struct sp_query *est, const struct sp_query *exact, int count) {
+    int right = 0, paths = 0, missed = 0, below = 0;
+    double stretch = 0, worst = 1;
+    for (int i=0; i < count; i++) {
+        int e = est[i].dist, x = exact[i].dist;
+        if (e == x) {
+            right++;
+        } else if (e < x) {
+            below++;
+        } else if (e == NC) {
+            missed++;
+        }
+        if (x != NC && x > 0 && e != NC && e >= x) {
+            double r = (double)e / x;
+            stretch += r;
+            paths++;
+            if (r > worst)
+                worst = r;
+        }
+    }
+    printf("Oracle error: %d of %d exact (%.1f%%), stretch mean %.3f max %.3f over %d paths, %d paths with no landmark route, %d below the true distance\n",
+           right, count, count > 0 ? 100.0 * right / count : 0, paths > 0 ? stretch / paths : 1, worst, paths, missed, below);
+}
+
+void oracle_report(const struct landmark_oracle *o, enum landmark_select select) {
+    double mb = (double)o->k * o->n * (o->from.width + o->to.width) / 1e6;
+    printf("Oracle: %d landmarks (%s) built in %f s, rows take %.1f MB (%d and %d byte entries) instead of %.1f MB for all pairs\n",
+           o->k, select_name(select), o->seconds, mb, o->from.width, o->to.width, (double)o->n * o->n * o->from.width / 1e6);
+}
@@ -0,0 +1,69 @@
+#ifndef ORACLE_H
+#define ORACLE_H
+
+#include <stdbool.h>
+#include "config.h"
+#include "distmat.h"
+#include "graph.h"
+#include "pool.h"
+#include "query.h"
+
+/*
+Landmark distance oracle, for graphs where even the V^2 result file is too big
+k landmarks L get one search each way, and only those 2k rows are kept (k x V, twice, since the graph is directed):
+    from row i: d(L_i, v) for every v
+    to row i:   d(v, L_i) for every v
+Any s -> t query is then bounded in O(k) by the triangle inequality, over every landmark L:
+    upper: d(s,L) + d(L,t), a real path through L
+    lower: d(L,t) - d(L,s) and d(s,L) - d(t,L)
+If L reaches s but not t (or t reaches L but s doesn't), s can't reach t at all, and that is exact
+The rows are dist_matrix rows, so they take a byte or two per entry on most graphs
+*/
+struct landmark_oracle {
+    int n;
+    int k;
+    int *landmarks;
+    struct dist_matrix from; // row i is d(landmarks[i], v)
+    struct dist_matrix to; // row i is d(v, landmarks[i])
+    const struct csr_graph *g;
+    struct csr_graph rev; // g transposed, for the searches to the landmarks and for exact queries
+    double seconds; // to pick the landmarks and compute their rows
+};
+
+/*
+Picks k landmarks (select) and computes their rows with engine e on the pool's threads, two searches per landmark
+degree picks them all up front and runs every search at once
+farthest starts from the highest degree node, then each landmark is the node furthest from all of the ones
+before it (unreachable counts as furthest), so it waits for their searches: only the two of one landmark run at once
+k is capped at n. Returns 0 on success
+*/
+int oracle_build(struct landmark_oracle *o, const struct csr_graph *g, enum engine e, int k,
+                 enum landmark_select select, struct thread_pool *pool);
+void oracle_free(struct landmark_oracle *o);
+
+// The bounds on d(s,t), lower <= d(s,t) <= upper. NC for upper when no landmark joins them, for both when s can't reach t
+void oracle_bounds(const struct landmark_oracle *o, int s, int t, int *lower, int *upper);
+
+/*
+Exact d(s,t): nothing to search when the bounds meet, otherwise query_pair_bounded with the upper bound,
+so the bidirectional search stops as soon as it can't beat the path through the best landmark
+*/
+int oracle_exact(const struct landmark_oracle *o, int s, int t, struct query_scratch *qs);
+
+/*
+Answers count queries on the pool: q[i].dist is the upper bound, or exact with refine (qs holds one scratch per pool thread)
+Fills in st, where groups counts the exact queries that had to search (0 without refine). Returns 0 on success
+*/
+int oracle_batch(const struct landmark_oracle *o, struct sp_query *q, int count, bool refine,
+                 struct query_scratch **qs, struct thread_pool *pool, struct query_stats *st);
+
+/*
+Compares the answers in est to the exact ones in exact (same queries, same order), for picking k:
+how many were exact, how far over the rest were (stretch = estimate / exact), and how many real paths had no estimate
+*/
+void oracle_report_error(const struct sp_query *est, const struct sp_query *exact, int count);
+
+// Prints k, how the landmarks were picked, the build time and the memory the rows take
+void oracle_report(const struct landmark_oracle *o, enum landmark_select select);
+
+#endif
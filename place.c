@@ -0,0 +1,260 @@
+#define _GNU_SOURCE // sched_getaffinity, pthread_setaffinity_np, syscall
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include "place.h"
+#include "pool.h"
+#include "sssp.h"
+
+// Memory policies from the kernel's mempolicy.h, numaif.h (and -lnuma) aren't on every cluster
+#define MPOL_PREFERRED 1
+#define MPOL_INTERLEAVE 3
+#define MPOL_MF_MOVE (1 << 1)
+
+// One bit per node, sized for PLACE_MAX_NODES
+typedef unsigned long node_mask[(PLACE_MAX_NODES + 63) / 64];
+
+// mbind(2) straight through syscall. The kernel drops the last of maxnode bits, hence the + 1
+static int sys_mbind(void *addr, size_t len, int mode, const node_mask mask, unsigned int flags) {
+#ifdef SYS_mbind
+    return (int) syscall(SYS_mbind, addr, len, mode, mask, (unsigned long)(sizeof(node_mask) * 8 + 1), flags);
+#else
+    (void) addr; (void) len; (void) mode; (void) mask; (void) flags;
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+// mbind on the whole pages inside bytes from p, the partial pages at either end are left alone
+static int mbind_inside(const void *p, size_t bytes, int mode, const node_mask mask, unsigned int flags) {
+    uintptr_t page = (uintptr_t) sysconf(_SC_PAGESIZE);
+    uintptr_t lo = ((uintptr_t) p + page - 1) / page * page;
+    uintptr_t hi = ((uintptr_t) p + bytes) / page * page;
+    if (hi <= lo)
+        return 0;
+    return sys_mbind((void *) lo, hi - lo, mode, mask, flags);
+}
+
+/*
+Reads a kernel CPU or node list ("0-7,16-23") from path, setting set[i] for every i in it below max
+Returns the number set, -1 when the file can't be read
+*/
+static int read_list(const char *path, bool *set, int max) {
+    FILE *f = fopen(path, "r");
+    if (f == NULL)
+        return -1;
+    char buf[4096];
+    int count = 0;
+    if (fgets(buf, sizeof(buf), f) != NULL) {
+        char *s = buf;
+        while (*s >= '0' && *s <= '9') {
+            long a = strtol(s, &s, 10), b = a;
+            if (*s == '-')
+                b = strtol(s + 1, &s, 10);
+            for (long i=a; i <= b && i < max; i++)
+                if (!set[i]) {
+                    set[i] = true;
+                    count++;
+                }
+            if (*s == ',')
+                s++;
+        }
+    }
+    fclose(f);
+    return count;
+}
+
+int topo_detect(struct numa_topology *t) {
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (sched_getaffinity(0, sizeof(allowed), &allowed))
+        for (int c=0; c < CPU_SETSIZE; c++)
+            CPU_SET(c, &allowed);
+    long online = sysconf(_SC_NPROCESSORS_ONLN);
+    t->online = online > 0 ? (int) online : 1;
+    t->ncpus = CPU_COUNT(&allowed);
+    if (t->ncpus < 1)
+        t->ncpus = 1;
+    t->nnodes = 0;
+    t->cpus = malloc(t->ncpus * sizeof(int));
+    t->cpu_node = malloc(t->ncpus * sizeof(int));
+    t->node_id = malloc(PLACE_MAX_NODES * sizeof(int));
+    t->first = malloc((PLACE_MAX_NODES + 1) * sizeof(int));
+    bool *nodes = calloc(PLACE_MAX_NODES, sizeof(bool));
+    bool *on_node = calloc(CPU_SETSIZE, sizeof(bool));
+    bool *placed = calloc(CPU_SETSIZE, sizeof(bool));
+    if (t->cpus == NULL || t->cpu_node == NULL || t->node_id == NULL || t->first == NULL ||
+        nodes == NULL || on_node == NULL || placed == NULL) {
+        printf("TOPO_DETECT: out of memory\n");
+        free(nodes);
+        free(on_node);
+        free(placed);
+        topo_free(t);
+        return -1;
+    }
+
+    // Every node that has any of the allowed CPUs, in the kernel's order
+    int found = 0;
+    if (read_list("/sys/devices/system/node/online", nodes, PLACE_MAX_NODES) > 0) {
+        for (int id=0; id < PLACE_MAX_NODES; id++) {
+            if (!nodes[id])
+                continue;
+            char path[64];
+            snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", id);
+            memset(on_node, 0, CPU_SETSIZE * sizeof(bool));
+            if (read_list(path, on_node, CPU_SETSIZE) <= 0)
+                continue;
+            int before = found;
+            for (int c=0; c < CPU_SETSIZE && found < t->ncpus; c++) {
+                if (on_node[c] && CPU_ISSET(c, &allowed) && !placed[c]) {
+                    placed[c] = true;
+                    t->cpus[found] = c;
+                    t->cpu_node[found] = t->nnodes;
+                    found++;
+                }
+            }
+            if (found > before) {
+                t->node_id[t->nnodes] = id;
+                t->first[t->nnodes++] = before;
+            }
+        }
+    }
+    // No sysfs, or CPUs it didn't list: one node with every allowed CPU
+    if (found < t->ncpus) {
+        found = 0;
+        for (int c=0; c < CPU_SETSIZE && found < t->ncpus; c++)
+            if (CPU_ISSET(c, &allowed)) {
+                t->cpus[found] = c;
+                t->cpu_node[found++] = 0;
+            }
+        t->ncpus = found > 0 ? found : 1;
+        if (found == 0)
+            t->cpus[0] = t->cpu_node[0] = 0;
+        t->nnodes = 1;
+        t->node_id[0] = 0;
+        t->first[0] = 0;
+    }
+    t->first[t->nnodes] = t->ncpus;
+    free(nodes);
+    free(on_node);
+    free(placed);
+    return 0;
+}
+
+void topo_free(struct numa_topology *t) {
+    free(t->cpus);
+    free(t->cpu_node);
+    free(t->node_id);
+    free(t->first);
+    t->cpus = t->cpu_node = t->node_id = t->first = NULL;
+}
+
+int place_threads(struct place_plan *plan, const struct numa_topology *t, enum placement mode,
+                  struct thread_pool *pool, int slot) {
+    int nthreads = pool->nthreads;
+    plan->mode = mode;
+    plan->nthreads = nthreads;
+    plan->nnodes = t->nnodes;
+    for (int k=0; k < t->nnodes; k++)
+        plan->node_id[k] = t->node_id[k];
+    plan->cpu = malloc(nthreads * sizeof(int));
+    plan->node = malloc(nthreads * sizeof(int));
+    if (plan->cpu == NULL || plan->node == NULL) {
+        printf("PLACE_THREADS: out of memory for %d threads\n", nthreads);
+        place_free(plan);
+        return -1;
+    }
+    if (mode == PLACE_NONE) {
+        for (int w=0; w < nthreads; w++)
+            plan->cpu[w] = plan->node[w] = -1;
+        printf("Placement: none, %d threads float over %d CPUs on %d NUMA node(s)\n", nthreads, t->ncpus, t->nnodes);
+        return 0;
+    }
+
+    cpu_set_t all;
+    CPU_ZERO(&all);
+    int refused = 0;
+    for (int w=0; w < nthreads; w++) {
+        int s = slot + w, i;
+        if (mode == PLACE_COMPACT) {
+            i = s % t->ncpus;
+        } else {
+            int k = s % t->nnodes;
+            int on_k = t->first[k+1] - t->first[k];
+            i = t->first[k] + (s / t->nnodes) % on_k;
+        }
+        plan->cpu[w] = t->cpus[i];
+        plan->node[w] = t->cpu_node[i];
+        cpu_set_t one;
+        CPU_ZERO(&one);
+        CPU_SET(t->cpus[i], &one);
+        CPU_SET(t->cpus[i], &all);
+        if (pthread_setaffinity_np(pool->threads[w], sizeof(one), &one))
+            refused++;
+    }
+    // The calling thread only sleeps (or talks MPI) while the workers run, it just stays near them
+    if (pthread_setaffinity_np(pthread_self(), sizeof(all), &all))
+        refused++;
+
+    printf("Placement: %s, %d threads on %d NUMA node(s), thread -> cpu(node):", place_name(mode), nthreads, t->nnodes);
+    for (int w=0; w < nthreads; w++)
+        printf(" %d(%d)", plan->cpu[w], t->node_id[plan->node[w]]);
+    printf("\n");
+    if (refused)
+        printf("PLACE_THREADS: %d pins were refused, those threads float\n", refused);
+    return 0;
+}
+
+void place_free(struct place_plan *plan) {
+    free(plan->cpu);
+    free(plan->node);
+    plan->cpu = plan->node = NULL;
+}
+
+int place_rows(const struct place_plan *plan, void *data, int rows, size_t row_bytes, const int *row_node) {
+    if (plan == NULL || plan->mode == PLACE_NONE || row_node == NULL)
+        return 0;
+    // One call per run of rows that go on the same node
+    for (int r=0; r < rows; ) {
+        int node = row_node[r], end = r + 1;
+        while (end < rows && row_node[end] == node)
+            end++;
+        if (node >= 0) {
+            node_mask mask = {0};
+            int id = plan->node_id[node];
+            mask[id / 64] |= 1UL << (id % 64);
+            if (mbind_inside((char *) data + r * row_bytes, (end - r) * row_bytes, MPOL_PREFERRED, mask, 0))
+                return -1;
+        }
+        r = end;
+    }
+    return 0;
+}
+
+int place_graph(const struct place_plan *plan, const struct csr_graph *g, const struct dense_adj *dense) {
+    if (plan == NULL || plan->mode == PLACE_NONE || plan->nnodes < 2)
+        return 0;
+    node_mask mask = {0};
+    for (int k=0; k < plan->nnodes; k++)
+        mask[plan->node_id[k] / 64] |= 1UL << (plan->node_id[k] % 64);
+    int rc = 0;
+    // A graph mapped from a file lives in the page cache, shared with every other process mapping it
+    if (g != NULL && g->map == NULL) {
+        rc |= mbind_inside(g->off, (g->n + 1) * sizeof(int64_t), MPOL_INTERLEAVE, mask, MPOL_MF_MOVE);
+        rc |= mbind_inside(g->adj, g->nnz * sizeof(int), MPOL_INTERLEAVE, mask, MPOL_MF_MOVE);
+        if (g->w != NULL)
+            rc |= mbind_inside(g->w, g->nnz * sizeof(int), MPOL_INTERLEAVE, mask, MPOL_MF_MOVE);
+    }
+    if (dense != NULL && dense->bits != NULL)
+        rc |= mbind_inside(dense->bits, (size_t) dense->n * dense->words * sizeof(uint64_t), MPOL_INTERLEAVE, mask, MPOL_MF_MOVE);
+    if (dense != NULL && dense->w != NULL)
+        rc |= mbind_inside(dense->w, (size_t) dense->n * dense->n * sizeof(int), MPOL_INTERLEAVE, mask, MPOL_MF_MOVE);
+    return rc ? -1 : 0;
+}
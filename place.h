@@ -0,0 +1,75 @@
+#ifndef PLACE_H
+#define PLACE_H
+
+#include <stddef.h>
+#include "config.h"
+#include "graph.h"
+
+struct thread_pool;
+struct dense_adj;
+
+// Most NUMA nodes a node mask (and so the placement) can name
+#define PLACE_MAX_NODES 64
+
+/*
+The CPUs this process may run on, grouped by the NUMA node they belong to
+Read from /sys/devices/system/node, and limited to the process's affinity mask, so a launcher that already
+gave a process a subset of the cores (srun --cpu-bind, mpirun --bind-to) is respected
+Without the sysfs files (not Linux, or no NUMA support) it is one node holding every allowed CPU
+*/
+struct numa_topology {
+    int nnodes; // nodes with at least one allowed CPU
+    int ncpus; // allowed CPUs
+    int *cpus; // the allowed CPUs, node by node
+    int *cpu_node; // the node of cpus[i]
+    int *node_id; // the kernel's number of node k (the nodes found may not be numbered 0:nnodes-1)
+    int *first; // cpus[first[k]] : cpus[first[k+1]-1] are on node k (nnodes+1 entries)
+    int online; // CPUs online in the whole machine, more than ncpus when a launcher restricted this process
+};
+
+// Returns 0 on success
+int topo_detect(struct numa_topology *t);
+void topo_free(struct numa_topology *t);
+
+/*
+Where every worker of one pool runs (-P)
+    compact: worker k on the k-th allowed CPU, filling node 0 before node 1
+    spread:  workers dealt round robin over the nodes, so every node gets the same share of the threads
+slot is where this process's workers start counting, so processors sharing a node take different cores
+Workers past the last CPU wrap around and share
+*/
+struct place_plan {
+    enum placement mode;
+    int nthreads;
+    int nnodes;
+    int *cpu; // CPU of every worker, -1 for PLACE_NONE
+    int *node; // NUMA node (index into the topology) of every worker, -1 for PLACE_NONE
+    int node_id[PLACE_MAX_NODES]; // kernel node number of every topology node
+};
+
+/*
+Works out the plan and pins every thread of the pool (and the calling thread, to all of its workers' CPUs,
+so whatever it allocates afterwards lands near them). Prints the placement it ended up with
+Returns 0 on success. A pin the kernel refuses is reported, and that worker is left floating
+*/
+int place_threads(struct place_plan *plan, const struct numa_topology *t, enum placement mode,
+                  struct thread_pool *pool, int slot);
+void place_free(struct place_plan *plan);
+
+/*
+Pages of data (rows rows of row_bytes each) prefer the NUMA node of row_node[r] (-1 = leave the row alone)
+Only pages not touched yet are affected: they are faulted in on that node by whichever thread writes them first,
+so the rows of a worker end up on its node even if another thread allocated (or widened) the matrix
+Returns 0 on success, -1 when the kernel has no NUMA policy support
+*/
+int place_rows(const struct place_plan *plan, void *data, int rows, size_t row_bytes, const int *row_node);
+
+/*
+The read only graph (and the dense layout, when there is one) interleaved page by page over every node,
+moving the pages that are already there. Every thread reads all of it, so no one node should hold it all
+Either can be NULL, and a graph mapped from a file is left in the page cache. A no-op on one node
+Returns 0 on success
+*/
+int place_graph(const struct place_plan *plan, const struct csr_graph *g, const struct dense_adj *dense);
+
+#endif
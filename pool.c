@@ -0,0 +1,232 @@
+#define _POSIX_C_SOURCE 200809L // sysconf
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "instrument.h"
+#include "pool.h"
+#include "timing.h"
+
+int pool_default_threads(void) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    return cpus > 0 ? (int)cpus : 1;
+}
+
+// Owner side: lowest chunk first, to keep walking its sources in order
+static int take_own(struct pool_deque *q) {
+    int c = -1;
+    pthread_mutex_lock(&q->lock);
+    if (q->head < q->tail)
+        c = q->chunks[q->head++];
+    pthread_mutex_unlock(&q->lock);
+    return c;
+}
+
+// Thief side: highest chunk, the one the owner would get to last
+static int take_back(struct pool_deque *q) {
+    int c = -1;
+    pthread_mutex_lock(&q->lock);
+    if (q->head < q->tail)
+        c = q->chunks[--q->tail];
+    pthread_mutex_unlock(&q->lock);
+    return c;
+}
+
+// Runs chunks until every deque is empty. Nothing adds chunks mid job, so empty everywhere means done
+static void work(struct thread_pool *p, int me, unsigned int *rng) {
+    struct pool_worker_stats *st = &p->stats[me];
+    for (;;) {
+        int c = take_own(&p->deques[me]);
+        if (c < 0) {
+            // Start at a random victim so the thieves don't all pile onto worker 0
+            *rng = *rng * 1103515245u + 12345u;
+            int start = (int)((*rng >> 16) % (unsigned int)p->nthreads);
+            for (int k=0; k < p->nthreads && c < 0; k++) {
+                int victim = (start + k) % p->nthreads;
+                if (victim != me)
+                    c = take_back(&p->deques[victim]);
+            }
+            if (c < 0)
+                return;
+            st->steals++;
+        }
+        int lo = p->first + c * p->chunk;
+        int hi = lo + p->chunk - 1;
+        if (hi > p->last)
+            hi = p->last;
+        double t0 = wall_time();
+        p->fn(p->ctx, me, lo, hi);
+        st->busy += wall_time() - t0;
+        st->chunks++;
+    }
+}
+
+struct worker_arg {
+    struct thread_pool *p;
+    int id;
+};
+
+static void *worker_main(void *arg) {
+    struct worker_arg *wa = (struct worker_arg *) arg;
+    struct thread_pool *p = wa->p;
+    int me = wa->id;
+    free(wa);
+    INSTR_THREAD("pool", me);
+    unsigned int rng = 2463534242u + me;
+    unsigned long seen = 0;
+
+    pthread_mutex_lock(&p->lock);
+    for (;;) {
+        while (!p->shutdown && p->generation == seen)
+            pthread_cond_wait(&p->start, &p->lock);
+        if (p->shutdown)
+            break;
+        seen = p->generation;
+        pthread_mutex_unlock(&p->lock);
+
+        work(p, me, &rng);
+
+        pthread_mutex_lock(&p->lock);
+        if (--p->running == 0)
+            pthread_cond_signal(&p->done);
+    }
+    pthread_mutex_unlock(&p->lock);
+    return NULL;
+}
+
+struct thread_pool *pool_create(int nthreads) {
+    if (nthreads <= 0)
+        nthreads = pool_default_threads();
+    struct thread_pool *p = calloc(1, sizeof(struct thread_pool));
+    if (p == NULL)
+        return NULL;
+    p->nthreads = nthreads;
+    p->threads = malloc(nthreads * sizeof(pthread_t));
+    p->deques = calloc(nthreads, sizeof(struct pool_deque));
+    p->stats = calloc(nthreads, sizeof(struct pool_worker_stats));
+    if (p->threads == NULL || p->deques == NULL || p->stats == NULL) {
+        printf("POOL_CREATE: out of memory for %d threads\n", nthreads);
+        free(p->threads);
+        free(p->deques);
+        free(p->stats);
+        free(p);
+        return NULL;
+    }
+    pthread_mutex_init(&p->lock, NULL);
+    pthread_cond_init(&p->start, NULL);
+    pthread_cond_init(&p->done, NULL);
+    for (int t=0; t < nthreads; t++)
+        pthread_mutex_init(&p->deques[t].lock, NULL);
+
+    for (int t=0; t < nthreads; t++) {
+        struct worker_arg *wa = malloc(sizeof(struct worker_arg));
+        int rc = -1;
+        if (wa != NULL) {
+            wa->p = p;
+            wa->id = t;
+            rc = pthread_create(&p->threads[t], NULL, worker_main, wa);
+        }
+        if (rc) {
+            // Unlikely, but in case of error catch it
+            // https://hpc-tutorials.llnl.gov/posix/example_code/hello_arg2.c
+            printf("POOL_CREATE: could not start thread %d (return code %d)\n", t, rc);
+            free(wa);
+            // pool_destroy stops and cleans up the t workers already running, the rest never got a thread
+            for (int u=t; u < nthreads; u++)
+                pthread_mutex_destroy(&p->deques[u].lock);
+            p->nthreads = t;
+            pool_destroy(p);
+            return NULL;
+        }
+    }
+    return p;
+}
+
+void pool_destroy(struct thread_pool *p) {
+    if (p == NULL)
+        return;
+    pthread_mutex_lock(&p->lock);
+    p->shutdown = true;
+    pthread_cond_broadcast(&p->start);
+    pthread_mutex_unlock(&p->lock);
+    for (int t=0; t < p->nthreads; t++) {
+        pthread_join(p->threads[t], NULL);
+        pthread_mutex_destroy(&p->deques[t].lock);
+        free(p->deques[t].chunks);
+    }
+    pthread_mutex_destroy(&p->lock);
+    pthread_cond_destroy(&p->start);
+    pthread_cond_destroy(&p->done);
+    free(p->threads);
+    free(p->deques);
+    free(p->stats);
+    free(p);
+}
+
+void pool_run(struct thread_pool *p, int first, int last, int chunk, pool_task fn, void *ctx) {
+    if (last < first)
+        return;
+    if (chunk <= 0)
+        chunk = 1;
+    int nchunks = (int)(((long)last - first + chunk) / chunk);
+
+    // The workers are all asleep between runs, so the deques can be refilled without locking them
+    int per = (nchunks + p->nthreads - 1) / p->nthreads;
+    if (per > p->capacity) {
+        for (int t=0; t < p->nthreads; t++) {
+            free(p->deques[t].chunks);
+            p->deques[t].chunks = malloc(per * sizeof(int));
+            if (p->deques[t].chunks == NULL) {
+                printf("POOL_RUN: out of memory for %d chunks\n", nchunks);
+                exit(-1);
+            }
+        }
+        p->capacity = per;
+    }
+    // Contiguous blocks of chunks per worker, the same split the static starts[]/ends[] used to make
+    for (int t=0; t < p->nthreads; t++) {
+        struct pool_deque *q = &p->deques[t];
+        int lo = (int)((long)nchunks * t / p->nthreads);
+        int hi = (int)((long)nchunks * (t+1) / p->nthreads);
+        q->head = 0;
+        q->tail = hi - lo;
+        for (int c=lo; c < hi; c++)
+            q->chunks[c-lo] = c;
+    }
+
+    double t0 = wall_time();
+    pthread_mutex_lock(&p->lock);
+    p->fn = fn;
+    p->ctx = ctx;
+    p->first = first;
+    p->last = last;
+    p->chunk = chunk;
+    p->running = p->nthreads;
+    p->generation++;
+    pthread_cond_broadcast(&p->start);
+    while (p->running > 0)
+        pthread_cond_wait(&p->done, &p->lock);
+    pthread_mutex_unlock(&p->lock);
+    p->wall += wall_time() - t0;
+}
+
+int pool_owner(const struct thread_pool *p, int first, int last, int chunk, int item) {
+    if (chunk <= 0)
+        chunk = 1;
+    long nchunks = ((long)last - first + chunk) / chunk;
+    long c = (item - first) / chunk;
+    // Worker t starts with chunks nchunks*t/nthreads : nchunks*(t+1)/nthreads - 1, see pool_run
+    return (int)(((c + 1) * p->nthreads - 1) / nchunks);
+}
+
+void pool_report(const struct thread_pool *p) {
+    double total = 0;
+    printf("Thread utilization over %f s of pool runs:\n", p->wall);
+    for (int t=0; t < p->nthreads; t++) {
+        const struct pool_worker_stats *st = &p->stats[t];
+        double util = p->wall > 0 ? 100.0 * st->busy / p->wall : 0;
+        printf("  thread %d: busy %f s (%.1f%%), %ld chunks, %ld stolen\n", t, st->busy, util, st->chunks, st->steals);
+        total += st->busy;
+    }
+    if (p->wall > 0)
+        printf("  average utilization: %.1f%%\n", 100.0 * total / (p->wall * p->nthreads));
+}
@@ -0,0 +1,83 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include <pthread.h>
+#include <stdbool.h>
+
+/*
+A task handles the items lo:hi (inclusive), on pool thread worker (0:nthreads-1)
+worker is what lets a task reuse per-thread buffers, like one sssp_scratch per worker
+*/
+typedef void (*pool_task)(void *ctx, int worker, int lo, int hi);
+
+/*
+One deque of chunk indeces per worker
+The owner takes chunks from the front (lowest source first), thieves take from the back,
+so the two ends only meet when the deque is almost empty
+A mutex per deque is plenty since a chunk is many sources worth of work
+*/
+struct pool_deque {
+    pthread_mutex_t lock;
+    int *chunks;
+    int head; // next chunk the owner takes
+    int tail; // one past the last chunk, thieves take tail-1
+};
+
+// Running totals per worker, so the utilization can be reported after every run
+struct pool_worker_stats {
+    double busy; // seconds spent inside tasks
+    long chunks; // chunks run
+    long steals; // chunks taken from another worker's deque
+};
+
+/*
+Persistent thread pool with work stealing
+The threads are created once and sleep between runs, so tight can hand it several jobs
+(the all pairs rows, then queries, etc.) without creating threads again
+*/
+struct thread_pool {
+    int nthreads;
+    pthread_t *threads;
+    struct pool_deque *deques;
+    struct pool_worker_stats *stats;
+    int capacity; // chunk slots in every deque
+
+    // Current job, guarded by lock
+    pthread_mutex_t lock;
+    pthread_cond_t start; // signaled when a new job is posted (or on shutdown)
+    pthread_cond_t done; // signaled when the last worker finishes a job
+    unsigned long generation; // bumped for every job, how workers tell a new job from the last
+    int running; // workers still busy on the current job
+    bool shutdown;
+    pool_task fn;
+    void *ctx;
+    int first; // first item of the job
+    int last; // last item of the job (inclusive)
+    int chunk; // items per chunk
+    double wall; // seconds the runs have taken so far, for utilization
+};
+
+// Starts nthreads workers (pool_default_threads for 0 or less). NULL if they can't all be started
+struct thread_pool *pool_create(int nthreads);
+void pool_destroy(struct thread_pool *p);
+
+/*
+Runs fn over the items first:last, in chunks of chunk items, and returns once all are done
+Chunks start out split evenly and contiguously over the workers (same as the old starts[]/ends[]),
+then idle workers steal from busy ones
+*/
+void pool_run(struct thread_pool *p, int first, int last, int chunk, pool_task fn, void *ctx);
+
+/*
+The worker whose deque item starts out in when pool_run splits first:last into chunks of chunk
+Unless it gets stolen, that is the thread that handles it, so its memory can go on that thread's NUMA node
+*/
+int pool_owner(const struct thread_pool *p, int first, int last, int chunk, int item);
+
+// Prints busy time, utilization, chunks and steals of every worker
+void pool_report(const struct thread_pool *p);
+
+// Number of CPUs online, the default thread count
+int pool_default_threads(void);
+
+#endif
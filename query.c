@@ -0,0 +1,252 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "query.h"
+#include "timing.h"
+
+struct query_scratch *query_scratch_create(int n) {
+    struct query_scratch *qs = calloc(1, sizeof(struct query_scratch));
+    if (qs == NULL)
+        return NULL;
+    qs->n = n;
+    bool ok = true;
+    for (int side=0; side < 2; side++) {
+        qs->dist[side] = malloc(n * sizeof(int));
+        qs->touched[side] = malloc(n * sizeof(int));
+        qs->heap[side] = heap_create(n);
+        ok = ok && qs->dist[side] && qs->touched[side] && qs->heap[side];
+        if (qs->dist[side])
+            for (int i=0; i < n; i++)
+                qs->dist[side][i] = NC;
+    }
+    qs->want = calloc(n, sizeof(int));
+    if (!ok || qs->want == NULL) {
+        printf("QUERY_SCRATCH_CREATE: out of memory for %d nodes\n", n);
+        query_scratch_free(qs);
+        return NULL;
+    }
+    return qs;
+}
+
+void query_scratch_free(struct query_scratch *qs) {
+    if (qs == NULL)
+        return;
+    for (int side=0; side < 2; side++) {
+        free(qs->dist[side]);
+        free(qs->touched[side]);
+        heap_free(qs->heap[side]);
+    }
+    free(qs->want);
+    free(qs);
+}
+
+// Sets dist[side][v], remembering v so it can be reset later
+static void set_dist(struct query_scratch *qs, int side, int v, int d) {
+    if (qs->dist[side][v] == NC)
+        qs->touched[side][qs->ntouched[side]++] = v;
+    qs->dist[side][v] = d;
+}
+
+// Puts one side back the way query_scratch_create left it
+static void reset_side(struct query_scratch *qs, int side) {
+    for (int i=0; i < qs->ntouched[side]; i++)
+        qs->dist[side][qs->touched[side][i]] = NC;
+    qs->ntouched[side] = 0;
+    heap_clear(qs->heap[side]);
+}
+
+int query_pair(const struct csr_graph *g, const struct csr_graph *rev, int s, int t, struct query_scratch *qs) {
+    return query_pair_bounded(g, rev, s, t, NC, qs);
+}
+
+int query_pair_bounded(const struct csr_graph *g, const struct csr_graph *rev, int s, int t, int bound, struct query_scratch *qs) {
+    if (s == t)
+        return 0;
+    const struct csr_graph *graph[2] = {g, rev};
+    set_dist(qs, 0, s, 0);
+    heap_push_or_decrease(qs->heap[0], qs->dist[0], s);
+    set_dist(qs, 1, t, 0);
+    heap_push_or_decrease(qs->heap[1], qs->dist[1], t);
+
+    // Best s-t path seen so far, a long since dist + weight + dist can pass INT_MAX
+    // A known path of length bound stops both sides as soon as they can't beat it
+    long long best = bound;
+    while (qs->heap[0]->size > 0 && qs->heap[1]->size > 0) {
+        int top0 = qs->dist[0][qs->heap[0]->nodes[0]];
+        int top1 = qs->dist[1][qs->heap[1]->nodes[0]];
+        // Any path still to be found is at least top0 + top1 long
+        if ((long long)top0 + top1 >= best)
+            break;
+        int side = top0 <= top1 ? 0 : 1;
+        const struct csr_graph *gr = graph[side];
+        int *d = qs->dist[side];
+        const int *other = qs->dist[1 - side];
+        int u = heap_pop(qs->heap[side], d);
+        for (int64_t e = gr->off[u]; e < gr->off[u+1]; e++) {
+            int v = gr->adj[e];
+            int alt = dist_add(d[u], gr->w ? gr->w[e] : 1);
+            if (alt < d[v]) {
+                set_dist(qs, side, v, alt);
+                heap_push_or_decrease(qs->heap[side], d, v);
+            }
+            // v was reached from the other end too, so there is a path through u->v
+            if (other[v] != NC && (long long)alt + other[v] < best)
+                best = (long long)alt + other[v];
+        }
+    }
+    reset_side(qs, 0);
+    reset_side(qs, 1);
+    return best < NC ? (int)best : NC;
+}
+
+void query_source(const struct csr_graph *g, struct sp_query *q, int count, struct query_scratch *qs) {
+    int src = q[0].src;
+    int *dist = qs->dist[0];
+    struct min_heap *h = qs->heap[0];
+
+    // Number of distinct targets that are not settled yet
+    int pending = 0;
+    for (int i=0; i < count; i++)
+        if (qs->want[q[i].dst]++ == 0)
+            pending++;
+
+    set_dist(qs, 0, src, 0);
+    heap_push_or_decrease(h, dist, src);
+    // Same loop as dijkstra_heap, except it stops once the last target is popped (settled)
+    while (h->size > 0 && pending > 0) {
+        int u = heap_pop(h, dist);
+        if (qs->want[u])
+            pending--;
+        for (int64_t e = g->off[u]; e < g->off[u+1]; e++) {
+            int j = g->adj[e];
+            int alt = dist_add(dist[u], g->w ? g->w[e] : 1);
+            if (alt < dist[j]) {
+                set_dist(qs, 0, j, alt);
+                heap_push_or_decrease(h, dist, j);
+            }
+        }
+    }
+    // Every target is either settled (final) or was never reached (NC)
+    for (int i=0; i < count; i++) {
+        q[i].dist = dist[q[i].dst];
+        qs->want[q[i].dst] = 0;
+    }
+    reset_side(qs, 0);
+}
+
+int query_engine_init(struct query_engine *qe, const struct csr_graph *g, struct thread_pool *pool) {
+    qe->g = g;
+    qe->pool = pool;
+    if (csr_transpose(g, &qe->rev))
+        return -1;
+    qe->scratch = malloc(pool->nthreads * sizeof(struct query_scratch *));
+    if (qe->scratch == NULL)
+        return -1;
+    for (int t=0; t < pool->nthreads; t++) {
+        qe->scratch[t] = query_scratch_create(g->n);
+        if (qe->scratch[t] == NULL)
+            return -1;
+    }
+    return 0;
+}
+
+void query_engine_free(struct query_engine *qe) {
+    for (int t=0; t < qe->pool->nthreads; t++)
+        query_scratch_free(qe->scratch[t]);
+    free(qe->scratch);
+    csr_free(&qe->rev);
+}
+
+// Everything the pool task needs for one batch
+struct query_job {
+    struct query_engine *qe;
+    struct sp_query *q;
+    int *group; // group i is q[group[i]] : q[group[i+1]-1]
+};
+
+// pool_task over groups lo:hi
+static void query_some(void *job, int worker, int lo, int hi) {
+    struct query_job *j = (struct query_job *) job;
+    struct query_scratch *qs = j->qe->scratch[worker];
+    for (int gi=lo; gi <= hi; gi++) {
+        struct sp_query *q = &j->q[j->group[gi]];
+        int count = j->group[gi+1] - j->group[gi];
+        double t0 = wall_time();
+        if (count == 1)
+            q->dist = query_pair(j->qe->g, &j->qe->rev, q->src, q->dst, qs);
+        else
+            query_source(j->qe->g, q, count, qs);
+        // Every query of the group was answered by the same search, so they all waited this long
+        double took = wall_time() - t0;
+        for (int i=0; i < count; i++)
+            q[i].latency = took;
+    }
+}
+
+static int by_source(const void *a, const void *b) {
+    const struct sp_query *x = a, *y = b;
+    if (x->src != y->src)
+        return x->src < y->src ? -1 : 1;
+    return (x->dst > y->dst) - (x->dst < y->dst);
+}
+
+static int by_value(const void *a, const void *b) {
+    double x = *(const double *) a, y = *(const double *) b;
+    return (x > y) - (x < y);
+}
+
+int query_batch(struct query_engine *qe, struct sp_query *q, int count, struct query_stats *st) {
+    st->queries = count;
+    st->groups = 0;
+    st->wall = st->p50 = st->p99 = st->max = 0;
+    if (count <= 0)
+        return 0;
+    for (int i=0; i < count; i++) {
+        if (q[i].src < 0 || q[i].src >= qe->g->n || q[i].dst < 0 || q[i].dst >= qe->g->n) {
+            printf("QUERY_BATCH: query %d -> %d is out of bounds\n", q[i].src, q[i].dst);
+            return -1;
+        }
+    }
+
+    double t0 = wall_time();
+    qsort(q, count, sizeof(struct sp_query), by_source);
+    int *group = malloc((count + 1) * sizeof(int));
+    if (group == NULL)
+        return -1;
+    int ngroups = 0;
+    for (int i=0; i < count; i++)
+        if (i == 0 || q[i].src != q[i-1].src)
+            group[ngroups++] = i;
+    group[ngroups] = count;
+
+    // One group per chunk: groups vary a lot in cost, and there are only a few thousand of them
+    struct query_job job = {qe, q, group};
+    pool_run(qe->pool, 0, ngroups - 1, 1, query_some, &job);
+    st->wall = wall_time() - t0;
+    st->groups = ngroups;
+    free(group);
+
+    return query_latencies(q, count, st);
+}
+
+int query_latencies(const struct sp_query *q, int count, struct query_stats *st) {
+    st->p50 = st->p99 = st->max = 0;
+    if (count <= 0)
+        return 0;
+    double *lat = malloc(count * sizeof(double));
+    if (lat == NULL)
+        return -1;
+    for (int i=0; i < count; i++)
+        lat[i] = q[i].latency;
+    qsort(lat, count, sizeof(double), by_value);
+    st->p50 = lat[(count - 1) / 2];
+    st->p99 = lat[(int)((count - 1) * 0.99)];
+    st->max = lat[count - 1];
+    free(lat);
+    return 0;
+}
+
+void query_report(const struct query_stats *st) {
+    printf("Queries: %d in %d searches, %f s (%.0f queries/s), latency p50 %.1f us, p99 %.1f us, max %.1f us\n",
+           st->queries, st->groups, st->wall, st->wall > 0 ? st->queries / st->wall : 0,
+           st->p50 * 1e6, st->p99 * 1e6, st->max * 1e6);
+}
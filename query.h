@@ -0,0 +1,91 @@
+#ifndef QUERY_H
+#define QUERY_H
+
+#include "graph.h"
+#include "pool.h"
+#include "sssp.h"
+
+/*
+One "distance from src to dst" request
+dist is filled in by query_batch (NC when dst can't be reached), latency is how long its search took
+*/
+struct sp_query {
+    int src;
+    int dst;
+    int dist;
+    double latency; // seconds
+};
+
+/*
+Working memory for one thread's searches, one side per search direction (0 forward, 1 backward)
+Only the nodes a search touched are reset afterwards, so a query that stops early costs what it visited,
+not O(V) like the all pairs kernels that start every source by filling a whole row
+*/
+struct query_scratch {
+    int n;
+    int *dist[2]; // tentative distances, NC when untouched
+    struct min_heap *heap[2];
+    int *touched[2]; // nodes whose dist was set, to put back to NC
+    int ntouched[2];
+    int *want; // per node, how many queries of the current group target it
+};
+
+struct query_scratch *query_scratch_create(int n);
+void query_scratch_free(struct query_scratch *qs);
+
+/*
+Distance from s to t with bidirectional dijkstra
+A forward search from s on g and a backward search from t on rev take turns (the one with the smaller
+frontier key goes), and stop once the two frontier keys add up to at least the best s-t path seen so far
+Each side only has to reach about half way, so far less of the graph is settled than by one search from s
+rev must be g transposed (csr_transpose)
+*/
+int query_pair(const struct csr_graph *g, const struct csr_graph *rev, int s, int t, struct query_scratch *qs);
+
+/*
+query_pair, already knowing some s-t path of length bound (NC for none)
+The search stops as soon as the frontiers can't beat it, and bound itself is the answer when nothing shorter turns up
+*/
+int query_pair_bounded(const struct csr_graph *g, const struct csr_graph *rev, int s, int t, int bound, struct query_scratch *qs);
+
+/*
+Fills in q[i].dist for count queries that all share the source q[0].src
+One dijkstra from the source that stops as soon as every target is settled, instead of settling all V nodes
+*/
+void query_source(const struct csr_graph *g, struct sp_query *q, int count, struct query_scratch *qs);
+
+// Answers batches of queries on a pool of threads, built once and reused for every batch
+struct query_engine {
+    const struct csr_graph *g;
+    struct csr_graph rev;
+    struct thread_pool *pool;
+    struct query_scratch **scratch; // one per pool thread
+};
+
+// Timing of one batch
+struct query_stats {
+    int queries;
+    int groups; // distinct sources, each one search
+    double wall; // seconds for the whole batch
+    double p50, p99, max; // latency of a single query, seconds
+};
+
+// Returns 0 on success. The engine uses pool but does not own it
+int query_engine_init(struct query_engine *qe, const struct csr_graph *g, struct thread_pool *pool);
+void query_engine_free(struct query_engine *qe);
+
+/*
+Answers every query in q (sorting q by source, then destination, along the way)
+Queries with the same source are one group and share one early stopping search (query_source),
+a source with a single query uses query_pair. The groups are spread over the pool's threads
+Returns 0 on success
+*/
+int query_batch(struct query_engine *qe, struct sp_query *q, int count, struct query_stats *st);
+
+// Fills in the p50/p99/max latency of st from q's latencies. Returns 0 on success
+int query_latencies(const struct sp_query *q, int count, struct query_stats *st);
+
+// Prints a one line summary of st
+void query_report(const struct query_stats *st);
+
+#endif
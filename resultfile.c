@@ -0,0 +1,315 @@
+#define _POSIX_C_SOURCE 200809L // pwrite, pread, posix_fallocate
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "resultfile.h"
+#include "apsp.h"
+#include "instrument.h"
+#include "timing.h"
+
+int result_file_width(const struct csr_graph *g) {
+    int64_t longest = (int64_t)(g->n - 1) * csr_max_weight(g);
+    return dm_width_for(longest < NC ? (int)longest : NC - 1);
+}
+
+// Narrowest width that holds every distance in the count entries of data, stored at width
+static int used_width(const void *data, int width, size_t count) {
+    if (width == 2) {
+        const uint16_t *v = data;
+        uint16_t largest = 0;
+        for (size_t i=0; i < count; i++)
+            largest = v[i] != UINT16_MAX && v[i] > largest ? v[i] : largest;
+        return dm_width_for(largest);
+    }
+    if (width == 4) {
+        const int *v = data;
+        int largest = 0;
+        for (size_t i=0; i < count; i++)
+            largest = v[i] != NC && v[i] > largest ? v[i] : largest;
+        return dm_width_for(largest);
+    }
+    return 1;
+}
+
+// pwrite all of buf, pwrite is allowed to write less than asked
+static int pwrite_all(int fd, const void *buf, size_t len, off_t off) {
+    const char *p = buf;
+    while (len > 0) {
+        ssize_t done = pwrite(fd, p, len, off);
+        if (done <= 0)
+            return -1;
+        p += done;
+        len -= done;
+        off += done;
+    }
+    return 0;
+}
+
+int result_file_prepare(const char *path, int n, int width) {
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        printf("RESULT_FILE_PREPARE: could not create %s\n", path);
+        return -1;
+    }
+    char header[RESULT_FILE_HEADER];
+    memset(header, 0, sizeof(header));
+    struct result_file_header *h = (struct result_file_header *) header;
+    memcpy(h->magic, RESULT_FILE_MAGIC, 8);
+    h->version = RESULT_FILE_VERSION;
+    h->width = width;
+    h->n = n;
+    off_t size = RESULT_FILE_HEADER + (off_t)n * n * width;
+    int rc = pwrite_all(fd, header, sizeof(header), 0);
+    // Reserve the blocks now so the writes later never run out of space halfway through
+    // Not every file system can, in which case the file just grows as the rows land
+    if (rc == 0 && posix_fallocate(fd, 0, size) != 0)
+        rc = ftruncate(fd, size);
+    if (close(fd) || rc) {
+        printf("RESULT_FILE_PREPARE: could not size %s for %d x %d distances\n", path, n, n);
+        return -1;
+    }
+    return 0;
+}
+
+// Writes the queued batches in order until the file is closing and nothing is left
+static void *writer_main(void *arg) {
+    struct result_file *rf = (struct result_file *) arg;
+    INSTR_THREAD("writer", 0);
+    pthread_mutex_lock(&rf->lock);
+    for (;;) {
+        while (rf->qcount == 0 && !rf->closing)
+            pthread_cond_wait(&rf->changed, &rf->lock);
+        if (rf->qcount == 0)
+            break;
+        int slot = rf->queue[rf->qhead];
+        rf->qhead = (rf->qhead + 1) % rf->nslots;
+        rf->qcount--;
+        pthread_mutex_unlock(&rf->lock);
+
+        // A batch is consecutive rows, so it is one contiguous write
+        struct result_slot *sl = &rf->slots[slot];
+        size_t len = (size_t)sl->count * rf->n * rf->width;
+        off_t off = RESULT_FILE_HEADER + (off_t)sl->d.first * rf->n * rf->width;
+        INSTR_BEGIN(mark, PHASE_OUTPUT);
+        double t0 = wall_time();
+        int rc = pwrite_all(rf->fd, sl->d.data, len, off);
+        double took = wall_time() - t0;
+        INSTR_END(mark, PHASE_OUTPUT);
+        if (rf->used < rf->width) {
+            int used = used_width(sl->d.data, rf->width, (size_t)sl->count * rf->n);
+            rf->used = used > rf->used ? used : rf->used;
+        }
+
+        pthread_mutex_lock(&rf->lock);
+        if (rc)
+            rf->failed = true;
+        rf->write_time += took;
+        rf->bytes += len;
+        rf->free_slots[rf->nfree++] = slot;
+        pthread_cond_broadcast(&rf->changed);
+    }
+    pthread_mutex_unlock(&rf->lock);
+    return NULL;
+}
+
+struct result_file *result_file_open(const char *path, int n, int width, int batch, int nslots) {
+    struct result_file *rf = calloc(1, sizeof(struct result_file));
+    if (rf == NULL)
+        return NULL;
+    rf->fd = open(path, O_WRONLY);
+    if (rf->fd < 0) {
+        printf("RESULT_FILE_OPEN: could not open %s\n", path);
+        free(rf);
+        return NULL;
+    }
+    rf->n = n;
+    rf->width = width;
+    rf->used = 1;
+    rf->batch = batch > 0 ? batch : 1;
+    rf->nslots = nslots > 0 ? nslots : 1;
+    rf->slots = calloc(rf->nslots, sizeof(struct result_slot));
+    rf->free_slots = malloc(rf->nslots * sizeof(int));
+    rf->queue = malloc(rf->nslots * sizeof(int));
+    if (rf->slots == NULL || rf->free_slots == NULL || rf->queue == NULL) {
+        printf("RESULT_FILE_OPEN: out of memory for %d buffers\n", rf->nslots);
+        exit(-1);
+    }
+    for (int i=0; i < rf->nslots; i++) {
+        // Each buffer is fixed at the file's width, result_file_width makes sure nothing is wider
+        if (dm_init_width(&rf->slots[i].d, 0, rf->batch, n, width))
+            exit(-1);
+        rf->free_slots[rf->nfree++] = i;
+    }
+    pthread_mutex_init(&rf->lock, NULL);
+    pthread_cond_init(&rf->changed, NULL);
+    int rc = pthread_create(&rf->writer, NULL, writer_main, rf);
+    if (rc) {
+        printf("ERROR; return code from pthread_create() is %d\n", rc);
+        exit(-1);
+    }
+    return rf;
+}
+
+void result_file_rows(struct result_file *rf, const struct apsp_input *in, int lo, int hi, struct sssp_scratch *s) {
+    for (int first=lo; first <= hi; first += rf->batch) {
+        // Wait for a free buffer, this is what bounds the memory (and lets the disk set the pace)
+        pthread_mutex_lock(&rf->lock);
+        while (rf->nfree == 0)
+            pthread_cond_wait(&rf->changed, &rf->lock);
+        int slot = rf->free_slots[--rf->nfree];
+        pthread_mutex_unlock(&rf->lock);
+
+        struct result_slot *sl = &rf->slots[slot];
+        sl->count = hi - first + 1 < rf->batch ? hi - first + 1 : rf->batch;
+        sl->d.first = first;
+        apsp_rows(in, first, first + sl->count - 1, &sl->d, s);
+
+        pthread_mutex_lock(&rf->lock);
+        rf->queue[(rf->qhead + rf->qcount) % rf->nslots] = slot;
+        rf->qcount++;
+        pthread_cond_broadcast(&rf->changed);
+        pthread_mutex_unlock(&rf->lock);
+    }
+}
+
+int result_file_close(struct result_file *rf, int *used) {
+    pthread_mutex_lock(&rf->lock);
+    rf->closing = true;
+    pthread_cond_broadcast(&rf->changed);
+    pthread_mutex_unlock(&rf->lock);
+    pthread_join(rf->writer, NULL);
+
+    bool failed = rf->failed;
+    *used = rf->used;
+    if (close(rf->fd))
+        failed = true;
+    printf("Result file: %.1f MB written in %f s of I/O (%d buffers of %d rows)\n",
+           rf->bytes / 1e6, rf->write_time, rf->nslots, rf->batch);
+    if (failed)
+        printf("RESULT_FILE_CLOSE: some rows could not be written\n");
+
+    for (int i=0; i < rf->nslots; i++)
+        dm_free(&rf->slots[i].d);
+    pthread_mutex_destroy(&rf->lock);
+    pthread_cond_destroy(&rf->changed);
+    free(rf->slots);
+    free(rf->free_slots);
+    free(rf->queue);
+    free(rf);
+    return failed ? -1 : 0;
+}
+
+// pread all of len, like pwrite_all
+static int pread_all(int fd, void *buf, size_t len, off_t off) {
+    char *p = buf;
+    while (len > 0) {
+        ssize_t done = pread(fd, p, len, off);
+        if (done <= 0)
+            return -1;
+        p += done;
+        len -= done;
+        off += done;
+    }
+    return 0;
+}
+
+int result_file_narrow(const char *path, int width) {
+    int fd = open(path, O_RDWR);
+    struct result_file_header h;
+    if (fd < 0 || pread_all(fd, &h, sizeof(h), 0) || memcmp(h.magic, RESULT_FILE_MAGIC, 8) != 0) {
+        printf("RESULT_FILE_NARROW: %s is not a result file\n", path);
+        if (fd >= 0)
+            close(fd);
+        return -1;
+    }
+    int n = (int) h.n, from = h.width;
+    if (width >= from)
+        return close(fd);
+
+    // A few MB of rows at a time. Row r only moves down (to r*n*width from r*n*from), so a batch written
+    // at its new offset never reaches a row that hasn't been read yet
+    int batch = (int)((1 << 22) / ((size_t)n * from));
+    batch = batch < 1 ? 1 : batch < n ? batch : n;
+    struct dist_matrix wide, narrow;
+    int *vals = malloc(n * sizeof(int));
+    if (vals == NULL || dm_init_width(&wide, 0, batch, n, from)) {
+        printf("RESULT_FILE_NARROW: out of memory for %d rows\n", batch);
+        free(vals);
+        close(fd);
+        return -1;
+    }
+    if (dm_init_width(&narrow, 0, batch, n, width)) {
+        dm_free(&wide);
+        free(vals);
+        close(fd);
+        return -1;
+    }
+    double t0 = wall_time();
+    int rc = 0;
+    for (int first=0; first < n && rc == 0; first += batch) {
+        int count = n - first < batch ? n - first : batch;
+        rc = pread_all(fd, wide.data, (size_t)count * n * from, RESULT_FILE_HEADER + (off_t)first * n * from);
+        for (int r=0; r < count && rc == 0; r++) {
+            dm_get_row(&wide, r, vals);
+            dm_store_row(&narrow, r, vals);
+        }
+        // dm_store_row widens rather than lose a distance, which would mean width was too narrow
+        if (rc == 0 && narrow.width != width) {
+            printf("RESULT_FILE_NARROW: %s has distances that need more than %d byte(s)\n", path, width);
+            rc = -1;
+        }
+        if (rc == 0)
+            rc = pwrite_all(fd, narrow.data, (size_t)count * n * width, RESULT_FILE_HEADER + (off_t)first * n * width);
+    }
+    h.width = width;
+    if (rc == 0)
+        rc = pwrite_all(fd, &h, sizeof(h), 0);
+    if (rc == 0)
+        rc = ftruncate(fd, RESULT_FILE_HEADER + (off_t)n * n * width);
+    if (close(fd) || rc) {
+        printf("RESULT_FILE_NARROW: could not rewrite %s\n", path);
+        rc = -1;
+    } else {
+        printf("Result file: narrowed from %d to %d byte entries in %f s\n", from, width, wall_time() - t0);
+    }
+    dm_free(&wide);
+    dm_free(&narrow);
+    free(vals);
+    return rc;
+}
+
+int result_file_print(const char *path) {
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        printf("RESULT_FILE_PRINT: could not open %s\n", path);
+        return -1;
+    }
+    struct result_file_header h;
+    if (fread(&h, sizeof(h), 1, f) != 1 || memcmp(h.magic, RESULT_FILE_MAGIC, 8) != 0 || fseek(f, RESULT_FILE_HEADER, SEEK_SET)) {
+        printf("RESULT_FILE_PRINT: %s is not a result file\n", path);
+        fclose(f);
+        return -1;
+    }
+    // One row at a time through a one row dist_matrix, so printing needs no more memory than computing did
+    int n = (int) h.n;
+    struct dist_matrix row;
+    int *vals = malloc(n * sizeof(int));
+    if (vals == NULL || dm_init_width(&row, 0, 1, n, h.width)) {
+        free(vals);
+        fclose(f);
+        return -1;
+    }
+    for (int r=0; r < n; r++) {
+        if (fread(row.data, h.width, n, f) != (size_t)n)
+            break;
+        dm_get_row(&row, 0, vals);
+        print_row(vals, n);
+    }
+    printf("\n");
+    dm_free(&row);
+    free(vals);
+    fclose(f);
+    return 0;
+}
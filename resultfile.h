@@ -0,0 +1,104 @@
+#ifndef RESULTFILE_H
+#define RESULTFILE_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "distmat.h"
+
+struct apsp_input;
+struct sssp_scratch;
+
+/*
+Result file (-o): the whole dist matrix on disk, so it never has to fit in memory
+    header, padded to RESULT_FILE_HEADER bytes so the rows start page aligned
+    n rows of n entries, width bytes each, same encoding as struct dist_matrix
+    (the max value of the type means no connection)
+The file is sized up front, so any thread or processor can write any rows at their final offset
+That also fixes the width before the first row exists, so rows are written at a bound (see result_file_width),
+not the real longest distance. result_file_close reports the width the rows really needed, and
+result_file_narrow rewrites the file at that width, so it ends up no wider than an in memory dist_matrix
+*/
+#define RESULT_FILE_MAGIC "APSPDST1"
+#define RESULT_FILE_VERSION 1
+#define RESULT_FILE_HEADER 4096
+
+struct result_file_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t width;
+    int64_t n;
+};
+
+/*
+One batch buffer: a dist_matrix of up to batch rows, pointed at whatever rows it currently holds
+*/
+struct result_slot {
+    struct dist_matrix d;
+    int count; // rows it holds right now
+};
+
+/*
+Rows are computed into a small, fixed set of batch buffers and written out by one writer thread,
+so the compute threads never wait on the disk unless every buffer is queued up behind it
+Memory is nslots * batch rows, no matter how big n gets
+*/
+struct result_file {
+    int fd;
+    int n;
+    int width;
+    int batch; // rows per slot
+    int nslots;
+    struct result_slot *slots;
+
+    pthread_mutex_t lock;
+    pthread_cond_t changed; // a slot was freed, a batch was queued, or the file is closing
+    int *free_slots; // stack of free slots
+    int nfree;
+    int *queue; // ring of slots waiting to be written
+    int qhead, qcount;
+    bool closing;
+    bool failed; // a write went wrong, reported by result_file_close
+    pthread_t writer;
+    double write_time; // seconds the writer spent in pwrite
+    int64_t bytes; // bytes written
+    int used; // narrowest width that holds every row written so far (only the writer touches it)
+};
+
+/*
+Width the file uses for g: the narrowest that holds the longest possible shortest path, (n-1) * heaviest edge
+The widths have to be fixed before the first row is written, since rows go straight to their final offsets
+(from many processors in loose), so there is no widening later like dm_widen: 1 byte only up to n = 255 hops
+The rows are written at this width, and result_file_narrow takes the file down to the real one at the end
+*/
+int result_file_width(const struct csr_graph *g);
+
+// Creates path (replacing what was there), writes the header and sizes it for n rows. Returns 0 on success
+int result_file_prepare(const char *path, int n, int width);
+
+// Opens a prepared file for writing rows, with nslots buffers of batch rows each. NULL on error
+struct result_file *result_file_open(const char *path, int n, int width, int batch, int nslots);
+
+/*
+Computes rows lo:hi with apsp_rows and queues them to be written, a batch at a time
+Blocks only while every buffer is still waiting to be written. Safe to call from many threads
+*/
+void result_file_rows(struct result_file *rf, const struct apsp_input *in, int lo, int hi, struct sssp_scratch *s);
+
+/*
+Writes out what is still queued, stops the writer and closes the file. Returns 0 if every write worked
+*used gets the narrowest width that holds every row rf wrote, for result_file_narrow
+*/
+int result_file_close(struct result_file *rf, int *used);
+
+/*
+Rewrites the rows of path at width, in place, and shrinks the file to match. Every distance in it must fit
+A no-op when the file is no wider already. Only once every row is written (in loose, by every processor)
+Returns 0 on success
+*/
+int result_file_narrow(const char *path, int width);
+
+// Prints the matrix stored in path, same format as print_m
+int result_file_print(const char *path);
+
+#endif
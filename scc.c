@@ -0,0 +1,154 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "scc.h"
+
+/*
+Tarjan: a DFS that numbers nodes in the order it finds them (index), and tracks the lowest index each node
+can get back to through the nodes still on the component stack (low). A node whose low is its own index
+is the root of a component, which is everything above it on the component stack
+Components are finished sinks first, so the k-th finished one gets number count-1-k in the end
+The DFS keeps its own stack of (node, next edge to look at), the same state the recursion would have
+*/
+int scc_compute(const struct csr_graph *g, struct scc *c) {
+    int n = g->n;
+    c->n = n;
+    c->count = 0;
+    c->largest = 0;
+    c->comp = malloc(n * sizeof(int));
+    c->order = malloc(n * sizeof(int));
+    c->pos = malloc(n * sizeof(int));
+    c->first = NULL;
+    int *index = malloc(n * sizeof(int));
+    int *low = malloc(n * sizeof(int));
+    int *stack = malloc(n * sizeof(int)); // the component stack
+    int *dfs = malloc(n * sizeof(int)); // the DFS path
+    int64_t *edge = malloc(n * sizeof(int64_t)); // next edge of every node on the DFS path
+    if (c->comp == NULL || c->order == NULL || c->pos == NULL || index == NULL || low == NULL || stack == NULL || dfs == NULL || edge == NULL) {
+        printf("SCC_COMPUTE: out of memory for %d nodes\n", n);
+        free(index);
+        free(low);
+        free(stack);
+        free(dfs);
+        free(edge);
+        scc_free(c);
+        return -1;
+    }
+    // A node that has been found but has no component yet is always still on the component stack
+    for (int v=0; v < n; v++) {
+        index[v] = -1;
+        c->comp[v] = -1;
+    }
+
+    int next_index = 0, top = 0, finished = 0;
+    for (int root=0; root < n; root++) {
+        if (index[root] >= 0)
+            continue;
+        int depth = 0;
+        dfs[0] = root;
+        edge[root] = g->off[root];
+        index[root] = low[root] = next_index++;
+        stack[top++] = root;
+        while (depth >= 0) {
+            int u = dfs[depth];
+            if (edge[u] < g->off[u+1]) {
+                int v = g->adj[edge[u]++];
+                if (index[v] < 0) {
+                    // Not found yet, go down to it
+                    index[v] = low[v] = next_index++;
+                    stack[top++] = v;
+                    edge[v] = g->off[v];
+                    dfs[++depth] = v;
+                } else if (c->comp[v] < 0 && index[v] < low[u]) {
+                    low[u] = index[v];
+                }
+                continue;
+            }
+            // Every edge of u is done: it is either the root of a component, or it hands its low back up the path
+            if (low[u] == index[u]) {
+                int size = 0, v;
+                do {
+                    v = stack[--top];
+                    c->comp[v] = finished;
+                    size++;
+                } while (v != u);
+                finished++;
+                if (size > c->largest)
+                    c->largest = size;
+            }
+            depth--;
+            if (depth >= 0 && low[u] < low[dfs[depth]])
+                low[dfs[depth]] = low[u];
+        }
+    }
+    free(index);
+    free(low);
+    free(stack);
+    free(dfs);
+    free(edge);
+
+    // Sinks were finished first, turn that around into topological order, then list the nodes by component
+    c->count = finished;
+    c->first = calloc(finished + 1, sizeof(int));
+    if (c->first == NULL) {
+        printf("SCC_COMPUTE: out of memory for %d components\n", finished);
+        scc_free(c);
+        return -1;
+    }
+    for (int v=0; v < n; v++) {
+        c->comp[v] = finished - 1 - c->comp[v];
+        c->first[c->comp[v] + 1]++;
+    }
+    for (int k=0; k < finished; k++)
+        c->first[k+1] += c->first[k];
+    // Fill each component from its end down (so its nodes stay in order), which leaves first[k+1] at the start of k
+    for (int v=n-1; v >= 0; v--)
+        c->order[--c->first[c->comp[v] + 1]] = v;
+    for (int k=0; k < finished; k++)
+        c->first[k] = c->first[k+1];
+    c->first[finished] = n;
+    for (int k=0; k < n; k++)
+        c->pos[c->order[k]] = k;
+    return 0;
+}
+
+void scc_free(struct scc *c) {
+    free(c->comp);
+    free(c->order);
+    free(c->pos);
+    free(c->first);
+    c->comp = NULL;
+    c->order = NULL;
+    c->pos = NULL;
+    c->first = NULL;
+}
+
+int scc_relabel(const struct csr_graph *g, const struct scc *c, struct csr_graph *out) {
+    int n = g->n;
+    out->n = n;
+    out->nnz = g->nnz;
+    out->w = NULL;
+    out->map = NULL;
+    out->map_len = 0;
+    out->off = malloc((n + 1) * sizeof(int64_t));
+    out->adj = malloc((g->nnz > 0 ? g->nnz : 1) * sizeof(int));
+    if (g->w != NULL)
+        out->w = malloc((g->nnz > 0 ? g->nnz : 1) * sizeof(int));
+    if (out->off == NULL || out->adj == NULL || (g->w != NULL && out->w == NULL)) {
+        printf("SCC_RELABEL: could not allocate %lld edges\n", (long long)g->nnz);
+        csr_free(out);
+        return -1;
+    }
+    // Node k of out is node order[k] of g, its edges are copied over in the same order with their ends renumbered
+    out->off[0] = 0;
+    for (int k=0; k < n; k++) {
+        int u = c->order[k];
+        int64_t p = out->off[k];
+        for (int64_t e=g->off[u]; e < g->off[u+1]; e++, p++) {
+            out->adj[p] = c->pos[g->adj[e]];
+            if (g->w != NULL)
+                out->w[p] = g->w[e];
+        }
+        out->off[k+1] = p;
+    }
+    return 0;
+}
@@ -0,0 +1,36 @@
+#ifndef SCC_H
+#define SCC_H
+
+#include "graph.h"
+
+/*
+Strongly connected components, and the order of the condensation (the DAG with one node per component)
+Components are numbered in topological order: every edge between two different components goes from
+the lower number to the higher one. So from a node in component c, only components >= c can be reached,
+and listing the nodes by component puts everything a source can reach after where it sits itself
+*/
+struct scc {
+    int n;
+    int count; // number of components
+    int largest; // nodes in the biggest one
+    int *comp; // component of every node
+    int *order; // the nodes sorted by component
+    int *pos; // where every node sits in order (order[pos[v]] == v)
+    int *first; // order[first[c]] : order[first[c+1]-1] are the nodes of component c (count+1 entries)
+};
+
+/*
+Tarjan's algorithm, with an explicit stack instead of recursion (a long path would overflow the call stack)
+O(V+E), returns 0 on success
+*/
+int scc_compute(const struct csr_graph *g, struct scc *c);
+void scc_free(struct scc *c);
+
+/*
+Builds out, g with node order[k] renumbered to k, so every component is a contiguous range of nodes
+and every edge goes from a lower node to a higher one or stays inside its component
+A source in component c then can't reach anything below first[c]. Returns 0 on success
+*/
+int scc_relabel(const struct csr_graph *g, const struct scc *c, struct csr_graph *out);
+
+#endif
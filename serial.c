@@ -1,126 +1,202 @@
 #include <stdio.h>
 #include <stdbool.h>
 #include <stdlib.h>
-#include <time.h>
+#include "apsp.h"
+#include "bench.h"
+#include "graphio.h"
+#include "instrument.h"
+#include "incremental.h"
+#include "timing.h"
 
-#define M_SIZE 1000
-#define NC (M_SIZE*10 - 1) // Weight for No Connection (NC): Must be > M_SIZE in practice
-
-// I wrote these prints as a proof-of-concept regarding passing a single row of the matrix to a function
-// And also to see the matrix was generated sufficiently
-void print_row(int r[M_SIZE]) {
-    // Print the values of the row
-    for (int j=0; j<M_SIZE; j++)
-        printf("%d ", r[j]);
-    printf("\n");
-}
-void print_m(int m[M_SIZE][M_SIZE]) {
-    // Print matrix one row at a time
-    for (int i=0; i < M_SIZE; i++)
-        print_row(m[i]);
-    printf("\n");
-}
-
-// See dijkstra comments
-int minDistance(int dist[M_SIZE], bool sptSet[M_SIZE]) {
-    int min = NC, min_index;
-    for (int i = 0; i < M_SIZE; i++)
-        if (sptSet[i] == false && dist[i] <= min)
-            min = dist[i], min_index = i;
-    return min_index;
+/*
+This function gets the SP weight from all nodes to all other nodes
+The results are saved in a dist matrix
+The distance from src->des is available as dm_get(dist, src, des)
+** Note this is transposed compared to the connections found in m
+Computed by whichever engine in was set up with (see apsp_all)
+*/
+void dijkstra_all(const struct apsp_input *in, struct dist_matrix *dist) {
+    if (apsp_all(in, dist, 1))
+        exit(-1);
 }
 
 /*
-https://www.tutorialspoint.com/c-cplusplus-program-for-dijkstra-s-shortest-path-algorithm
-Small changes have been made from their function, including an out of bounds check and the return
-The function also assumes the matrix connections are in the rows, while the assignment says columns
-Because of this, I flipped the iterators when accessing m, hand verified to work for m_size=3,4,and 5
-This function takes in M, and a source point (0:M_SIZE-1)
-It then computes the least jumps from src to all nodes
-The distance from src->X is saved in dist[X]
+Update mode (-u count): a batch of random edge updates (from srand(seed + 1)) applied to g and repaired
+into dist by apsp_update, then checked against recomputing dist from scratch on the updated graph
+About a third each: insert an edge, delete an existing edge, change the weight of an existing edge
 */
-void dijkstra_one(int m[M_SIZE][M_SIZE], int src, int dist[M_SIZE]) {
-    // Bounds check
-    if (src >= M_SIZE) {
-        printf("DIJKSTRA_ONE OUT_OF_BOUNDS: %d",src);
-        return;
-    }
-
-    bool sptSet[M_SIZE]; 
-    for (int i = 0; i < M_SIZE; i++) {
-        dist[i] = NC;
-        sptSet[i] = false;
+static void run_updates(const struct run_config *cfg, struct csr_graph *g, struct dist_matrix *dist) {
+    int n = g->n;
+    struct edge_update *up = malloc(cfg->updates * sizeof(struct edge_update));
+    struct sssp_scratch *s = scratch_create(n);
+    if (up == NULL || s == NULL) {
+        printf("Not enough memory for %d updates\n", cfg->updates);
+        exit(-1);
     }
-    dist[src] = 0;
-    
-    for (int count = 0; count < M_SIZE - 1; count++) {
-        int u = minDistance(dist, sptSet);
-        sptSet[u] = true;
-        for (int j = 0; j < M_SIZE; j++) {
-            if (!sptSet[j] && m[j][u] && dist[u] != NC && (dist[u] + m[j][u]) < dist[j])
-                dist[j] = dist[u] + m[j][u];
+    srand(cfg->seed + 1);
+    for (int i=0; i < cfg->updates; i++) {
+        int u = rand() % n;
+        int kind = rand() % 3;
+        int64_t deg = g->off[u+1] - g->off[u];
+        up[i].u = u;
+        if (kind > 0 && deg > 0) {
+            up[i].v = g->adj[g->off[u] + rand() % deg];
+            up[i].op = kind == 1 ? EDGE_DELETE : EDGE_SET;
+            up[i].w = 1 + rand() % 5;
+        } else {
+            up[i].v = rand() % n;
+            up[i].op = EDGE_SET;
+            up[i].w = 1 + rand() % 3;
         }
-            
     }
-}
 
-/*
-This function gets the SP weight from all nodes to all other nodes
-The results are saved in a dist matrix
-The distance from src->des is available in dist[src][des]
-** Note this is transposed compared to the connections found in m
-*/
-void dijkstra_all(int m[M_SIZE][M_SIZE], int dist[M_SIZE][M_SIZE]) {
-    for (int i=0; i<M_SIZE; i++)
-        dijkstra_one(m, i, dist[i]);
+    struct update_stats st;
+    if (apsp_update(g, dist, up, cfg->updates, s, &st))
+        exit(-1);
+    printf("Update: %d increases, %d decreases in %f s (%d rows repaired, %lld nodes in them, %lld rows relaxed%s)\n",
+           st.increases, st.decreases, st.seconds, st.sources_repaired, (long long)st.nodes_repaired, (long long)st.rows_relaxed,
+           st.recomputed ? ", then gave up and recomputed every row" : "");
+
+    // Same answer as starting over?
+    double begin = wall_time();
+    struct dist_matrix full;
+    struct apsp_input in;
+    apsp_input_init(&in, ENGINE_AUTO, g, true);
+    if (dm_init(&full, 0, n, n) || apsp_all(&in, &full, 1))
+        exit(-1);
+    double full_time = wall_time() - begin;
+    long long wrong = 0;
+    for (int r=0; r < n; r++)
+        for (int c=0; c < n; c++)
+            wrong += dm_get(dist, r, c) != dm_get(&full, r, c);
+    printf("Full recompute (%s): %f s, incremental took %.2f%% of that, %lld entries differ\n",
+           engine_name(in.engine), full_time, full_time > 0 ? 100.0 * st.seconds / full_time : 0, wrong);
+
+    dm_free(&full);
+    apsp_input_free(&in);
+    scratch_free(s);
+    free(up);
 }
 
-int main() {
-    // Track the runtime of the program (measures CPU time, NOT wall time, which is desired)
-    // Learned from https://stackoverflow.com/questions/5248915/execution-time-of-c-program
-    // After completing all 3 parts, I am not sure the accuracy of this when threading is involved,
-    // as the results shown by this clock are much larger than the wall time the crc provides
-    clock_t begin = clock();
+int main(int argc, char *argv[]) {
+    // Track the runtime of the program
+    // This used to be clock(), which is CPU time summed over every thread, not the wall time the crc reports
+    // Now it is wall time, and the all pairs runs are timed on their own as well (see bench.h)
+    double begin = wall_time();
+    INSTR_THREAD("main", 0);
 
-    // Set the seed so the matrix M is deterministic
-    srand(0);
+    // Size, density and seed used to be compile time constants, now they come from the command line
+    struct run_config cfg;
+    if (parse_args(argc, argv, &cfg))
+        exit(-1);
 
-    // Create the matrix of relationships
+    // Create the graph of relationships
     // Randomly set every connection to 0 or 1 with SPLIT = % of connections (to adjust sparcity)
-    int split = 5;
-    int (*m)[M_SIZE] = malloc(sizeof(int[M_SIZE][M_SIZE]));
-    for (int i=0; i < M_SIZE; i++) {
-        for (int j=0; j < M_SIZE; j++) {
-            m[i][j] = rand()%100 < split;
+    // Generated straight into CSR so memory scales with the edges, not n^2
+    // Or, with -f, mapped from a graph file (the size then comes from the file)
+    INSTR_BEGIN(generate, PHASE_GENERATE);
+    struct csr_graph g;
+    if (graph_from_config(&cfg, &g))
+        exit(-1);
+    int n = cfg.n;
+    // Dense copy is only made for printing, the dense engine builds its own layout (see dense_adj)
+    int (*m)[n] = NULL;
+    if (cfg.print) {
+        m = malloc(sizeof(int[n][n]));
+        if (m == NULL) {
+            printf("Not enough memory for a dense %d x %d matrix\n", n, n);
+            exit(-1);
         }
-        // Set all diagonals to 1
-        // (Likely unecessary, but may cause unplanned issues and is logical to me anyway)
-        m[i][i] = 1;
+        csr_to_dense(&g, &(m[0][0]));
     }
+    INSTR_END(generate, PHASE_GENERATE);
 
     // Create the distance matrix for results
-    int (*dist)[M_SIZE] = malloc(sizeof(int[M_SIZE][M_SIZE]));
+    // It starts at a byte per entry and only widens if some distance does not fit (see distmat.h)
+    // With -o it holds nothing, the rows go straight to the file instead
+    struct dist_matrix dist;
+    if (dm_init(&dist, 0, cfg.out ? 0 : n, n))
+        exit(-1);
     // Calculate ALL shortest path weights
-    dijkstra_all(m,dist);
+    struct apsp_input in;
+    // With -o the whole matrix is never in memory, which rules out Floyd-Warshall
+    apsp_input_init(&in, cfg.engine, &g, cfg.out == NULL);
+    printf("Engine: %s\n", engine_name(in.engine));
+    if (cfg.components)
+        apsp_input_components(&in);
+    struct bench b;
+    if (bench_init(&b, "serial", &cfg))
+        exit(-1);
+    for (int run=0; run < cfg.warmup + cfg.reps; run++) {
+        double t0 = wall_time();
+        if (cfg.out) {
+            // A writer thread writes each batch while this thread computes the next one
+            int width = result_file_width(&g);
+            int batch = apsp_default_chunk(&in, n, 1);
+            if (result_file_prepare(cfg.out, n, width))
+                exit(-1);
+            struct result_file *out = result_file_open(cfg.out, n, width, batch, 2);
+            struct sssp_scratch *s = apsp_scratch_create(&in);
+            if (out == NULL || s == NULL)
+                exit(-1);
+            result_file_rows(out, &in, 0, n-1, s);
+            scratch_free(s);
+            int used;
+            if (result_file_close(out, &used) || result_file_narrow(cfg.out, used))
+                exit(-1);
+            b.width = used;
+        } else {
+            dijkstra_all(&in, &dist);
+            b.width = dist.width;
+        }
+        bench_add(&b, wall_time() - t0);
+    }
+    bench_report(&b);
+    if (cfg.check) {
+        b.wrong = cfg.out ? bench_check_file(&g, in.engine, cfg.out) : bench_check(&g, in.engine, &dist);
+        bench_check_report(&g, in.engine, b.wrong);
+    }
+    b.engine = engine_name(in.engine);
+    if (cfg.bench && bench_record(cfg.bench, &b, &cfg, &g))
+        exit(-1);
+    bench_free(&b);
+
+    if (cfg.out) {
+        printf("Distances written to %s\n", cfg.out);
+    } else {
+        printf("Distances stored in %d byte(s) each\n", dist.width);
+        if (cfg.updates > 0) {
+            run_updates(&cfg, &g, &dist);
+            // Keep the printed M in step with the updated graph
+            if (m != NULL)
+                csr_to_dense(&g, &(m[0][0]));
+        }
+    }
 
     // I disabled printing results when M_SIZE is large for a few reasons
     // 1: when large it is hard/impossible to compare at a glance
     // 2: program spends SIGNIFICANT amount of time just printing and this makes the timing data unreliable
     // I have included results of printed small arrays (proof of working) and large ones (just for the runtime for comparison)
-    if (M_SIZE <= 100) {
+    INSTR_BEGIN(output, PHASE_OUTPUT);
+    if (cfg.print) {
         printf("M = \n");
-        print_m(m);
+        print_m(n, &(m[0][0]));
         printf("Dist = \n");
-        print_m(dist);
+        if (cfg.out)
+            result_file_print(cfg.out);
+        else
+            dm_print(&dist);
     }
+    INSTR_END(output, PHASE_OUTPUT);
+    INSTR_REPORT("");
 
     // Take that valgrind!
     free(m);
-    free(dist);
+    dm_free(&dist);
+    apsp_input_free(&in);
+    csr_free(&g);
 
-    // Equation to get runtime in seconds, see earlier comment for source
-    clock_t end = clock();
-    double run_time = (double)(end - begin) / CLOCKS_PER_SEC;
+    double run_time = wall_time() - begin;
     // Display results
     printf("\nProgram runtime: %f\n", run_time);
-}
\ No newline at end of file
+}
@@ -0,0 +1,438 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sssp.h"
+#include "distmat.h"
+#include "instrument.h"
+
+struct min_heap *heap_create(int n) {
+    struct min_heap *h = malloc(sizeof(struct min_heap));
+    if (h == NULL)
+        return NULL;
+    h->size = 0;
+    h->nodes = malloc(n * sizeof(int));
+    h->pos = malloc(n * sizeof(int));
+    if (h->nodes == NULL || h->pos == NULL) {
+        heap_free(h);
+        return NULL;
+    }
+    for (int i=0; i < n; i++)
+        h->pos[i] = -1;
+    return h;
+}
+
+void heap_free(struct min_heap *h) {
+    if (h == NULL)
+        return;
+    free(h->nodes);
+    free(h->pos);
+    free(h);
+}
+
+// Move the node at index i up until its parent is no larger
+static void sift_up(struct min_heap *h, const int dist[], int i) {
+    int v = h->nodes[i];
+    while (i > 0) {
+        int parent = (i - 1) / 2;
+        int p = h->nodes[parent];
+        if (dist[p] <= dist[v])
+            break;
+        h->nodes[i] = p;
+        h->pos[p] = i;
+        i = parent;
+    }
+    h->nodes[i] = v;
+    h->pos[v] = i;
+}
+
+// Move the node at index i down until both children are no smaller
+static void sift_down(struct min_heap *h, const int dist[], int i) {
+    int v = h->nodes[i];
+    for (;;) {
+        int child = 2*i + 1;
+        if (child >= h->size)
+            break;
+        if (child + 1 < h->size && dist[h->nodes[child+1]] < dist[h->nodes[child]])
+            child++;
+        int c = h->nodes[child];
+        if (dist[v] <= dist[c])
+            break;
+        h->nodes[i] = c;
+        h->pos[c] = i;
+        i = child;
+    }
+    h->nodes[i] = v;
+    h->pos[v] = i;
+}
+
+void heap_push_or_decrease(struct min_heap *h, const int dist[], int v) {
+    if (h->pos[v] < 0) {
+        h->nodes[h->size] = v;
+        h->pos[v] = h->size;
+        h->size++;
+    }
+    sift_up(h, dist, h->pos[v]);
+}
+
+int heap_pop(struct min_heap *h, const int dist[]) {
+    int top = h->nodes[0];
+    h->pos[top] = -1;
+    h->size--;
+    if (h->size > 0) {
+        h->nodes[0] = h->nodes[h->size];
+        sift_down(h, dist, 0);
+    }
+    return top;
+}
+
+void heap_clear(struct min_heap *h) {
+    for (int i=0; i < h->size; i++)
+        h->pos[h->nodes[i]] = -1;
+    h->size = 0;
+}
+
+struct sssp_scratch *scratch_create(int n) {
+    struct sssp_scratch *s = malloc(sizeof(struct sssp_scratch));
+    if (s == NULL)
+        return NULL;
+    s->n = n;
+    s->sptSet = malloc(n * sizeof(bool));
+    s->heap = heap_create(n);
+    s->row = malloc(n * sizeof(int));
+    s->bfs_words = NULL;
+    s->dense_words = 0;
+    s->reached = NULL;
+    s->dial_head = NULL;
+    s->dial_links = NULL;
+    s->dial_buckets = 0;
+    s->comp_row = NULL;
+    if (s->sptSet == NULL || s->heap == NULL || s->row == NULL) {
+        printf("SCRATCH_CREATE: out of memory for %d nodes\n", n);
+        scratch_free(s);
+        return NULL;
+    }
+    return s;
+}
+
+void scratch_free(struct sssp_scratch *s) {
+    if (s == NULL)
+        return;
+    free(s->sptSet);
+    heap_free(s->heap);
+    free(s->row);
+    free(s->bfs_words);
+    free(s->reached);
+    free(s->dial_head);
+    free(s->dial_links);
+    free(s->comp_row);
+    free(s);
+}
+
+int scratch_reserve(struct sssp_scratch *s, int dense_words, int max_weight, bool bfs, bool comp) {
+    int n = s->n;
+    if (dense_words > s->dense_words) {
+        free(s->reached);
+        s->reached = malloc(dense_words * sizeof(uint64_t));
+        s->dense_words = s->reached ? dense_words : 0;
+    }
+    // Every bucket is empty again when a source finishes, so they are only cleared when made
+    int nb = max_weight > 0 ? max_weight + 1 : 0;
+    if (nb > s->dial_buckets) {
+        free(s->dial_head);
+        s->dial_head = malloc(nb * sizeof(int));
+        if (s->dial_links == NULL)
+            s->dial_links = malloc(2 * (size_t)n * sizeof(int));
+        s->dial_buckets = s->dial_head && s->dial_links ? nb : 0;
+        for (int b=0; b < s->dial_buckets; b++)
+            s->dial_head[b] = -1;
+    }
+    if (bfs && s->bfs_words == NULL)
+        s->bfs_words = malloc(sizeof(uint64_t[3][MSBFS_WORDS]) * n);
+    if (comp && s->comp_row == NULL)
+        s->comp_row = malloc(n * sizeof(int));
+    if (s->dense_words < dense_words || s->dial_buckets < nb || (bfs && s->bfs_words == NULL) || (comp && s->comp_row == NULL)) {
+        printf("SCRATCH_RESERVE: out of memory for %d nodes\n", n);
+        return -1;
+    }
+    return 0;
+}
+
+// See dijkstra comments
+int minDistance(int n, const int dist[n], const bool sptSet[n]) {
+    int min = NC, min_index = 0;
+    for (int i = 0; i < n; i++)
+        if (sptSet[i] == false && dist[i] <= min)
+            min = dist[i], min_index = i;
+    return min_index;
+}
+
+int dense_adj_build(struct dense_adj *a, const struct csr_graph *g) {
+    int n = g->n;
+    a->n = n;
+    a->words = (n + 63) / 64;
+    a->bits = NULL;
+    a->w = NULL;
+    bool unit = true;
+    for (int64_t e=0; e < g->nnz && unit; e++)
+        unit = g->w == NULL || g->w[e] == 1;
+    if (unit) {
+        a->bits = calloc((size_t)n * a->words, sizeof(uint64_t));
+        if (a->bits == NULL) {
+            printf("DENSE_ADJ_BUILD: out of memory for a %d x %d bit matrix\n", n, n);
+            return -1;
+        }
+        for (int u=0; u < n; u++)
+            for (int64_t e=g->off[u]; e < g->off[u+1]; e++)
+                a->bits[(size_t)u * a->words + g->adj[e] / 64] |= 1ULL << (g->adj[e] % 64);
+        return 0;
+    }
+    a->w = malloc((size_t)n * n * sizeof(int));
+    if (a->w == NULL) {
+        printf("DENSE_ADJ_BUILD: out of memory for a %d x %d matrix\n", n, n);
+        return -1;
+    }
+    for (size_t i=0; i < (size_t)n * n; i++)
+        a->w[i] = NC;
+    for (int u=0; u < n; u++) {
+        for (int64_t e=g->off[u]; e < g->off[u+1]; e++) {
+            // Parallel edges: only the lightest one matters, same as csr_to_dense
+            int *cell = &a->w[(size_t)u * n + g->adj[e]];
+            if (g->w[e] < *cell)
+                *cell = g->w[e];
+        }
+    }
+    return 0;
+}
+
+void dense_adj_free(struct dense_adj *a) {
+    free(a->bits);
+    free(a->w);
+    a->bits = NULL;
+    a->w = NULL;
+}
+
+/*
+https://www.tutorialspoint.com/c-cplusplus-program-for-dijkstra-s-shortest-path-algorithm
+Small changes have been made from their function, including an out of bounds check and the return
+The function also assumed the matrix connections are in the rows, while the assignment says columns,
+so it used to walk down column u of m (m[j][u]), a new cache line (and often a new page) for every j
+Now it walks row u of the dense_adj built for it, which is that column laid out contiguously
+This function takes in the layout, and a source point (0:n-1)
+Nodes below lo are never looked at (see sssp.h)
+*/
+void dijkstra_one(const struct dense_adj *a, int src, int lo, int dist[], struct sssp_scratch *s) {
+    int n = a->n;
+    // Bounds check
+    if (src < lo || src >= n) {
+        printf("DIJKSTRA_ONE OUT_OF_BOUNDS: %d",src);
+        return;
+    }
+
+    bool *sptSet = s->sptSet;
+    for (int i = lo; i < n; i++) {
+        dist[i] = NC;
+        sptSet[i] = false;
+    }
+    dist[src] = 0;
+    // No edge goes below lo, so the words before the one holding lo are never read or written
+    int lo_word = lo / 64;
+    uint64_t *reached = s->reached;
+    if (a->bits != NULL) {
+        memset(reached + lo_word, 0, (a->words - lo_word) * sizeof(uint64_t));
+        reached[src / 64] |= 1ULL << (src % 64);
+    }
+
+    INSTR_LOCAL(relaxed);
+    INSTR_LOCAL(updated);
+    INSTR_LOCAL(settled);
+    for (int count = 0; count < n - lo - 1; count++) {
+        INSTR_BEGIN(scan, PHASE_MIN_SCAN);
+        int u = lo + minDistance(n - lo, dist + lo, sptSet + lo);
+        INSTR_END(scan, PHASE_MIN_SCAN);
+        // Everything left is unreachable, relaxing from it could not change a thing
+        if (dist[u] == NC)
+            break;
+        sptSet[u] = true;
+        INSTR_INC(settled, 1);
+        INSTR_BEGIN(relax, PHASE_RELAX);
+        if (a->bits != NULL) {
+            // 0/1 graph: a node's first distance is its final one, so only nodes not reached yet can improve,
+            // and they all get dist[u] + 1. Whole words of the row are masked against reached at once
+            const uint64_t *row = a->bits + (size_t)u * a->words;
+            int alt = dist[u] + 1;
+            for (int k = lo_word; k < a->words; k++) {
+                uint64_t fresh = row[k] & ~reached[k];
+                INSTR_INC(relaxed, __builtin_popcountll(row[k]));
+                if (!fresh)
+                    continue;
+                reached[k] |= fresh;
+                INSTR_INC(updated, __builtin_popcountll(fresh));
+                while (fresh) {
+                    dist[k*64 + __builtin_ctzll(fresh)] = alt;
+                    fresh &= fresh - 1;
+                }
+            }
+        } else {
+            // Weighted: a plain contiguous min over the row, which the compiler turns into SIMD
+            // No edge is NC, and unsigned du + NC can't wrap and never beats dist[j], so it needs no check
+            // Settled nodes need none either: their dist is <= du already, and every weight is >= 1
+            const int *row = a->w + (size_t)u * n;
+            unsigned int du = dist[u];
+            for (int j = lo; j < n; j++) {
+                unsigned int alt = du + (unsigned int)row[j];
+                INSTR_INC(relaxed, row[j] != NC && !sptSet[j]);
+                INSTR_INC(updated, alt < (unsigned int)dist[j]);
+                dist[j] = alt < (unsigned int)dist[j] ? (int)alt : dist[j];
+            }
+        }
+        INSTR_END(relax, PHASE_RELAX);
+    }
+    INSTR_ADD(INSTR_RELAX, relaxed);
+    INSTR_ADD(INSTR_UPDATE, updated);
+    INSTR_ADD(INSTR_SCAN, (uint64_t)(n - lo) * (settled + 1));
+    INSTR_ADD(INSTR_SETTLE, settled);
+}
+
+/*
+Row src of out, all NC, for a kernel to fill in as it settles nodes (see dijkstra_heap)
+The store stays open until out_end, and out_settle reopens it wider when a distance doesn't fit
+*/
+static void out_begin(struct dist_matrix *out, int src) {
+    dm_begin_store(out, 0);
+    void *row = dm_row(out, src);
+    if (out->width < 4) {
+        memset(row, 0xff, (size_t)out->n * out->width);
+    } else {
+        for (int v = 0; v < out->n; v++)
+            ((int *) row)[v] = NC;
+    }
+}
+
+static inline void out_settle(struct dist_matrix *out, int src, int v, int dist) {
+    if (dist > dm_max(out->width)) {
+        dm_end_store(out);
+        dm_begin_store(out, dist);
+    }
+    dm_set(out, src, v, dist);
+}
+
+void dijkstra_heap(const struct csr_graph *g, int src, int dist[], struct sssp_scratch *s, struct dist_matrix *out) {
+    // Bounds check
+    if (src < 0 || src >= g->n) {
+        printf("DIJKSTRA_HEAP OUT_OF_BOUNDS: %d",src);
+        return;
+    }
+
+    struct min_heap *h = s->heap;
+    for (int i = 0; i < g->n; i++)
+        dist[i] = NC;
+    dist[src] = 0;
+    heap_push_or_decrease(h, dist, src);
+    if (out != NULL)
+        out_begin(out, src);
+
+    // Only reachable nodes ever enter the heap, so the loop ends as soon as they are all settled
+    // A node is settled when it is popped, and every pop leaves pos[] back at -1 for the next source
+    INSTR_LOCAL(settled);
+    INSTR_LOCAL(relaxed);
+    INSTR_LOCAL(updated);
+    while (h->size > 0) {
+        int u = heap_pop(h, dist);
+        if (out != NULL)
+            out_settle(out, src, u, dist[u]);
+        INSTR_INC(settled, 1);
+        INSTR_INC(relaxed, g->off[u+1] - g->off[u]);
+        for (int64_t e = g->off[u]; e < g->off[u+1]; e++) {
+            int j = g->adj[e];
+            int alt = dist_add(dist[u], g->w ? g->w[e] : 1);
+            if (alt < dist[j]) {
+                dist[j] = alt;
+                heap_push_or_decrease(h, dist, j);
+                INSTR_INC(updated, 1);
+            }
+        }
+    }
+    if (out != NULL)
+        dm_end_store(out);
+    // The heap hands over the next node without scanning, so scanned is just the pops
+    INSTR_ADD(INSTR_SETTLE, settled);
+    INSTR_ADD(INSTR_SCAN, settled);
+    INSTR_ADD(INSTR_RELAX, relaxed);
+    INSTR_ADD(INSTR_UPDATE, updated);
+}
+
+void dijkstra_dial(const struct csr_graph *g, int max_weight, int src, int dist[], struct sssp_scratch *s,
+                   struct dist_matrix *out) {
+    int n = g->n;
+    // Bounds check
+    if (src < 0 || src >= n) {
+        printf("DIJKSTRA_DIAL OUT_OF_BOUNDS: %d",src);
+        return;
+    }
+    // The buckets come from scratch_reserve, and are all empty again when a source finishes
+    int nb = max_weight + 1;
+    int *head = s->dial_head;
+    int *next = s->dial_links, *prev = s->dial_links + n;
+
+    for (int i = 0; i < n; i++)
+        dist[i] = NC;
+    dist[src] = 0;
+    head[0] = src;
+    next[src] = prev[src] = -1;
+    int queued = 1;
+    if (out != NULL)
+        out_begin(out, src);
+
+    INSTR_LOCAL(scanned);
+    INSTR_LOCAL(settled);
+    INSTR_LOCAL(relaxed);
+    INSTR_LOCAL(updated);
+    // d is the distance being settled, it only ever goes up
+    for (int d = 0; queued > 0; d++) {
+        int *bucket = &head[d % nb];
+        INSTR_INC(scanned, 1);
+        // Edges of weight 0 can add to this bucket while it is being emptied, which is fine
+        while (*bucket >= 0) {
+            int u = *bucket;
+            *bucket = next[u];
+            if (next[u] >= 0)
+                prev[next[u]] = -1;
+            queued--;
+            if (out != NULL)
+                out_settle(out, src, u, d);
+            INSTR_INC(settled, 1);
+            INSTR_INC(relaxed, g->off[u+1] - g->off[u]);
+            for (int64_t e = g->off[u]; e < g->off[u+1]; e++) {
+                int j = g->adj[e];
+                int alt = dist_add(d, g->w ? g->w[e] : 1);
+                if (alt >= dist[j])
+                    continue;
+                INSTR_INC(updated, 1);
+                // Settled nodes can never get here, so j is either new or queued in the bucket of dist[j]
+                if (dist[j] == NC) {
+                    queued++;
+                } else {
+                    if (prev[j] >= 0)
+                        next[prev[j]] = next[j];
+                    else
+                        head[dist[j] % nb] = next[j];
+                    if (next[j] >= 0)
+                        prev[next[j]] = prev[j];
+                }
+                dist[j] = alt;
+                int *to = &head[alt % nb];
+                next[j] = *to;
+                prev[j] = -1;
+                if (*to >= 0)
+                    prev[*to] = j;
+                *to = j;
+            }
+        }
+    }
+    if (out != NULL)
+        dm_end_store(out);
+    INSTR_ADD(INSTR_SETTLE, settled);
+    INSTR_ADD(INSTR_SCAN, scanned);
+    INSTR_ADD(INSTR_RELAX, relaxed);
+    INSTR_ADD(INSTR_UPDATE, updated);
+}
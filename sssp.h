@@ -0,0 +1,124 @@
+#ifndef SSSP_H
+#define SSSP_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "graph.h"
+
+struct dist_matrix;
+
+// Number of 64 bit words per node in the MS-BFS bitsets (see apsp.h)
+// 4 words = 256 sources per batch, which gcc turns into single AVX2 ops when built with -mavx2
+#ifndef MSBFS_WORDS
+#ifdef __AVX2__
+#define MSBFS_WORDS 4
+#else
+#define MSBFS_WORDS 1
+#endif
+#endif
+#define MSBFS_BATCH (64 * MSBFS_WORDS)
+
+/*
+Indexed binary min-heap of nodes, keyed on an external dist array
+pos[v] is where v currently sits in nodes[] (-1 when it is not in the heap),
+which is what lets dijkstra lower a node's key in O(log V) instead of pushing duplicates
+*/
+struct min_heap {
+    int size; // number of nodes currently in the heap
+    int *nodes; // the heap itself, nodes[0] has the smallest dist
+    int *pos; // position of every node in nodes[], or -1
+};
+
+struct min_heap *heap_create(int n);
+void heap_free(struct min_heap *h);
+// Insert v, or lower its key if it is already queued (dist[v] must already hold the new value)
+void heap_push_or_decrease(struct min_heap *h, const int dist[], int v);
+// Removes and returns the node with the smallest dist
+int heap_pop(struct min_heap *h, const int dist[]);
+// Empties the heap, for searches that stop before it runs dry
+void heap_clear(struct min_heap *h);
+
+/*
+Per thread (or per process) working memory for the single source kernels
+sptSet used to be a bool[M_SIZE] on the stack of dijkstra_one, which overflows the stack for large graphs
+Now it is allocated once, sized at runtime, and reused for every source the thread computes
+*/
+struct sssp_scratch {
+    int n;
+    bool *sptSet;
+    struct min_heap *heap;
+    int *row; // the int row a kernel computes into (the tentative distances, for heap and dial)
+    // Only some engines need these, scratch_reserve makes them
+    uint64_t *bfs_words; // seen/frontier/next bitsets for MS-BFS
+    int dense_words; // words of reached bitset for dijkstra_one on a 0/1 graph
+    uint64_t *reached;
+    int *dial_head; // first node of every bucket for dijkstra_dial
+    int *dial_links; // next (then prev) node in its bucket, n of each
+    int dial_buckets;
+    int *comp_row; // the row in the relabeled node order, for components (see apsp_rows)
+};
+
+struct sssp_scratch *scratch_create(int n);
+void scratch_free(struct sssp_scratch *s);
+
+/*
+Makes the buffers only some kernels use, up front, so the kernels never allocate (or run out of memory) mid run,
+on a worker thread or in one processor of many: dense_words of reached bitset for dijkstra_one on a 0/1 graph,
+buckets for dijkstra_dial up to max_weight, the MS-BFS bitsets with bfs and a relabeled row with comp
+0 or false skips one, and what is already big enough is kept. Returns 0 on success
+*/
+int scratch_reserve(struct sssp_scratch *s, int dense_words, int max_weight, bool bfs, bool comp);
+
+// See dijkstra comments
+int minDistance(int n, const int dist[n], const bool sptSet[n]);
+
+/*
+The adjacency laid out for dijkstra_one, built once and shared (read only) by every thread
+dijkstra_one relaxes every j from the node u it just settled, so the weights of u->j for all j are what
+it reads together: that is row u here (column u of the dense m). Unit weight graphs only need to know
+whether the edge is there, so they get one bit per edge, 32x smaller than m, and a whole 64 nodes per word
+*/
+struct dense_adj {
+    int n;
+    int words; // 64 bit words per row of bits
+    uint64_t *bits; // 0/1 graphs: bit j of row u is set when u->j is an edge (NULL otherwise)
+    int *w; // weighted graphs: w[u*n + j] is the lightest u->j, NC when there is none (NULL otherwise)
+};
+
+// Returns 0 on success
+int dense_adj_build(struct dense_adj *a, const struct csr_graph *g);
+void dense_adj_free(struct dense_adj *a);
+
+/*
+The original dense kernel, now sized at runtime
+It computes the least jumps (or weight) from src to all nodes in O(V^2)
+The distance from src->X is saved in dist[X]
+lo is the first node src could possibly reach: only lo:n-1 are scanned and relaxed, and dist[0:lo-1] is
+left untouched. 0 for any graph, first[c] of src's component on a graph relabeled by scc_relabel (see scc.h)
+*/
+void dijkstra_one(const struct dense_adj *a, int src, int lo, int dist[], struct sssp_scratch *s);
+
+/*
+Same result as dijkstra_one, but walks the CSR graph with a heap instead of scanning
+every node for the minimum and every row of m for neighbors
+Each source costs O((V+E) log V) instead of O(V^2)
+With out (NULL for none), every node's distance also goes straight into row src of out, at out's width, when
+the node is settled. Nodes settle in order of distance, so the row only ever has to widen once or twice,
+and there is no second pass to narrow dist[] into it (the way dm_store_row does)
+*/
+void dijkstra_heap(const struct csr_graph *g, int src, int dist[], struct sssp_scratch *s, struct dist_matrix *out);
+
+/*
+Dial's algorithm: dijkstra_heap with a bucket per distance instead of the heap, for small integer weights
+Every queued node is at most max_weight past the one being settled, so max_weight+1 buckets used in a circle
+hold all of them, and bucket d % (max_weight+1) only ever holds nodes at distance d
+Buckets are doubly linked lists through the nodes, so lowering a distance is an O(1) unlink and relink
+instead of a sift, and the next node is the head of the first bucket that isn't empty
+Each source costs O(V + E + its longest distance) instead of O((V+E) log V)
+Every weight must be in 0:max_weight
+out is the same as for dijkstra_heap
+*/
+void dijkstra_dial(const struct csr_graph *g, int max_weight, int src, int dist[], struct sssp_scratch *s,
+                   struct dist_matrix *out);
+
+#endif
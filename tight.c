@@ -1,203 +1,325 @@
 #include <stdio.h>
 #include <stdbool.h>
 #include <stdlib.h>
-#include <time.h>
 #include <pthread.h>
+#include "apsp.h"
+#include "bench.h"
+#include "graphio.h"
+#include "instrument.h"
+#include "oracle.h"
+#include "place.h"
+#include "pool.h"
+#include "query.h"
+#include "timing.h"
 
-#define M_SIZE 1000
-#define NC 9999 // Weight for No Connection (NC): Must be > M_SIZE in practice
-#define NUM_THREADS 10
-
-// Use struct to pass data to pthreads on creation
-// Based on https://hpc-tutorials.llnl.gov/posix/example_code/hello_arg2.c
-struct thread_data {
-    int thread_id; // # of thread (serves no purpose here)
-    int start; // node to start calculating SPs
-    int end; // node to end calculating SPs
-    int (*d)[M_SIZE]; // Pointer to dist matrix for results
-    int (*m)[M_SIZE]; // Pointer to M matrix to access graph
-};
-
-// I wrote these prints as a proof-of-concept regarding passing a single row of the matrix to a function
-// And also to see the matrix was generated sufficiently
-void print_row(int r[], int N) {
-    // Print the values of the row
-    for (int j=0; j<N; j++)
-        printf("%d ", r[j]);
-    printf("\n");
-}
-void print_m(int m[M_SIZE][M_SIZE]) {
-    // Print matrix one row at a time
-    for (int i=0; i < M_SIZE; i++)
-        print_row(m[i],M_SIZE);
-    printf("\n");
-}
+/*
+Online mode (-q pairs): answers random "distance from s to t" queries instead of computing all pairs
+The pairs come from srand(seed), so a run can be repeated, and are answered as one batch (see query_batch)
+*/
+static void run_queries(const struct run_config *cfg, const struct csr_graph *g) {
+    int nthreads = cfg->threads > 0 ? cfg->threads : pool_default_threads();
+    struct thread_pool *pool = pool_create(nthreads);
+    if (pool == NULL)
+        exit(-1);
+    struct query_engine qe;
+    if (query_engine_init(&qe, g, pool))
+        exit(-1);
 
-// See dijkstra comments
-int minDistance(int dist[M_SIZE], bool sptSet[M_SIZE]) {
-    int min = NC, min_index;
-    for (int i = 0; i < M_SIZE; i++)
-        if (sptSet[i] == false && dist[i] <= min)
-            min = dist[i], min_index = i;
-    return min_index;
+    struct sp_query *q = malloc(cfg->queries * sizeof(struct sp_query));
+    if (q == NULL) {
+        printf("Not enough memory for %d queries\n", cfg->queries);
+        exit(-1);
+    }
+    srand(cfg->seed);
+    for (int i=0; i < cfg->queries; i++) {
+        q[i].src = rand() % g->n;
+        q[i].dst = rand() % g->n;
+    }
+
+    struct query_stats st;
+    if (query_batch(&qe, q, cfg->queries, &st))
+        exit(-1);
+    printf("Threads = %d\n", nthreads);
+    query_report(&st);
+    pool_report(pool);
+    if (cfg->print)
+        for (int i=0; i < cfg->queries; i++)
+            printf("%d -> %d: %d\n", q[i].src, q[i].dst, q[i].dist);
+
+    free(q);
+    query_engine_free(&qe);
+    pool_destroy(pool);
 }
 
 /*
-https://www.tutorialspoint.com/c-cplusplus-program-for-dijkstra-s-shortest-path-algorithm
-Small changes have been made from their function, including an out of bounds check and the return
-The function also assumes the matrix connections are in the rows, while the assignment says columns
-Because of this, I flipped the iterators when accessing m, hand verified to work for m_size=3,4,and 5
-This function takes in M, and a source point (0:M_SIZE-1)
-It then computes the least jumps from src to all nodes
-The distance from src->X is saved in dist[X]
+Oracle mode (-L k): keeps 2k rows for k landmarks instead of all V^2 distances, and answers random queries from them
+(-q pairs, or 1000 when -q isn't given, from srand(seed) like run_queries), as estimates or exactly with -x
+With -k the same pairs are also answered exactly by bidirectional searches, and the estimates are scored against them
 */
-void dijkstra_one(int m[M_SIZE][M_SIZE], int src, int dist[M_SIZE]) {
-    // Bounds check
-    if (src >= M_SIZE) {
-        printf("DIJKSTRA_ONE OUT_OF_BOUNDS: %d",src);
-        return;
-    }
+static void run_oracle(const struct run_config *cfg, const struct csr_graph *g) {
+    int nthreads = cfg->threads > 0 ? cfg->threads : pool_default_threads();
+    struct thread_pool *pool = pool_create(nthreads);
+    if (pool == NULL)
+        exit(-1);
+    struct landmark_oracle o;
+    if (oracle_build(&o, g, cfg->engine, cfg->landmarks, cfg->select, pool))
+        exit(-1);
+    printf("Threads = %d\n", nthreads);
+    oracle_report(&o, cfg->select);
 
-    bool sptSet[M_SIZE]; 
-    for (int i = 0; i < M_SIZE; i++) {
-        dist[i] = NC;
-        sptSet[i] = false;
+    int count = cfg->queries > 0 ? cfg->queries : 1000;
+    struct sp_query *q = malloc(count * sizeof(struct sp_query));
+    struct query_scratch **qs = malloc(nthreads * sizeof(struct query_scratch *));
+    if (q == NULL || qs == NULL) {
+        printf("Not enough memory for %d queries\n", count);
+        exit(-1);
     }
-    dist[src] = 0;
-    
-    for (int count = 0; count < M_SIZE - 1; count++) {
-        int u = minDistance(dist, sptSet);
-        sptSet[u] = true;
-        for (int j = 0; j < M_SIZE; j++) {
-            if (!sptSet[j] && m[j][u] && dist[u] != NC && (dist[u] + m[j][u]) < dist[j])
-                dist[j] = dist[u] + m[j][u];
+    for (int t=0; t < nthreads; t++)
+        if ((qs[t] = query_scratch_create(g->n)) == NULL)
+            exit(-1);
+    srand(cfg->seed);
+    for (int i=0; i < count; i++) {
+        q[i].src = rand() % g->n;
+        q[i].dst = rand() % g->n;
+    }
+
+    struct query_stats st;
+    if (oracle_batch(&o, q, count, cfg->refine, qs, pool, &st))
+        exit(-1);
+    printf("Oracle %s: ", cfg->refine ? "exact" : "estimates");
+    query_report(&st);
+    pool_report(pool);
+    if (cfg->check) {
+        // One search per pair, in the same order as q (query_batch would sort them)
+        struct sp_query *exact = malloc(count * sizeof(struct sp_query));
+        if (exact == NULL) {
+            printf("Not enough memory for %d queries\n", count);
+            exit(-1);
+        }
+        for (int i=0; i < count; i++) {
+            exact[i] = q[i];
+            exact[i].dist = query_pair(g, &o.rev, q[i].src, q[i].dst, qs[0]);
         }
+        oracle_report_error(q, exact, count);
+        free(exact);
     }
-}
+    if (cfg->print)
+        for (int i=0; i < count; i++)
+            printf("%d -> %d: %d\n", q[i].src, q[i].dst, q[i].dist);
 
-/*
-This function gets the SP weight from all nodes to all other nodes
-The results are saved in a dist matrix
-The distance from src->des is available in dist[src][des]
-** Note this is transposed compared to the connections found in m
-*/
-void dijkstra_all(int m[M_SIZE][M_SIZE], int dist[M_SIZE][M_SIZE]) {
-    for (int i=0; i<M_SIZE; i++)
-        dijkstra_one(m, i, dist[i]);
+    for (int t=0; t < nthreads; t++)
+        query_scratch_free(qs[t]);
+    free(qs);
+    free(q);
+    oracle_free(&o);
+    pool_destroy(pool);
 }
 
 /*
-This function is the one ran by each pthread
-It begins by parsing the arguments into the appropriate data structure to access critical info
-It then simply runs dijkstra_one on each of its assigned nodes (from start:end inclusive)
-The results are stored as it goes into the row dist[i]
-dist is an M_SIZE*M_SIZE matrix that all threads are given access to
-This is okay, however since no threads have overlapping writes, as each is assigned different rows
-of dist to compute. Meaning, all threads can change dist as they progress and no locks are necessary, nice!
-M is also shared between all threads, but M is only read, so no worries there either
+Placement (-P): the NUMA node of the worker that starts out with every row of dist, for dm_place
+The pool hands out positions 0:n-1 in chunks, which are rows, or nodes of in->scc.order when it runs by component
 */
-void *dijkstra_some(void *threadarg) {
-    struct thread_data *my_data;
-    my_data = (struct thread_data *) threadarg;
-    int taskid = my_data->thread_id;
-    int start = my_data->start;
-    int end = my_data->end;
-    int (*m)[M_SIZE] = my_data->m;
-    int (*dist)[M_SIZE] = my_data->d;
-
-    for (int i=start; i<=end; i++)
-        dijkstra_one(m,i,dist[i]);
+static int *row_nodes(const struct place_plan *plan, const struct thread_pool *pool, const struct apsp_job *data, int n, int chunk) {
+    int *node = malloc(n * sizeof(int));
+    if (node == NULL) {
+        printf("Not enough memory to place %d rows\n", n);
+        exit(-1);
+    }
+    bool by_component = data->by_component && data->in->scc.comp != NULL;
+    for (int p=0; p < n; p++)
+        node[by_component ? data->in->scc.order[p] : p] = plan->node[pool_owner(pool, 0, n-1, chunk, p)];
+    return node;
 }
 
-int main() {
-    // Track the runtime of the program (measures CPU time, NOT wall time, which is desired)
-    // Learned from https://stackoverflow.com/questions/5248915/execution-time-of-c-program
-    // After completing all 3 parts, I am not sure the accuracy of this when threading is involved,
-    // as the results shown by this clock are much larger than the wall time the crc provides
-    clock_t begin = clock();
+int main(int argc, char *argv[]) {
+    // Track the runtime of the program
+    // This used to be clock(), which adds up the CPU time of every thread, so more threads looked slower
+    // Now it is wall time, and the all pairs runs are timed on their own as well (see bench.h)
+    double begin = wall_time();
+    INSTR_THREAD("main", 0);
 
-    // Set the seed so the matrix M is deterministic (for testing)
-    srand(0);
+    // Size, density and seed used to be compile time constants, now they come from the command line
+    struct run_config cfg;
+    if (parse_args(argc, argv, &cfg))
+        exit(-1);
 
-    // Create the matrix of relationships
+    // Create the graph of relationships
     // Randomly set every connection to 0 or 1 with SPLIT = % of connections (to adjust sparcity)
-    int split = 5;
-    int (*m)[M_SIZE] = malloc(sizeof(int[M_SIZE][M_SIZE]));
-    for (int i=0; i < M_SIZE; i++) {
-        for (int j=0; j < M_SIZE; j++) {
-            m[i][j] = rand()%100 < split;
+    // Generated straight into CSR so memory scales with the edges, not n^2
+    // Or, with -f, mapped from a graph file (the size then comes from the file)
+    INSTR_BEGIN(generate, PHASE_GENERATE);
+    struct csr_graph g;
+    if (graph_from_config(&cfg, &g))
+        exit(-1);
+    INSTR_END(generate, PHASE_GENERATE);
+    int n = cfg.n;
+    if (cfg.landmarks > 0) {
+        run_oracle(&cfg, &g);
+        csr_free(&g);
+        return 0;
+    }
+    if (cfg.queries > 0) {
+        run_queries(&cfg, &g);
+        csr_free(&g);
+        return 0;
+    }
+    // Dense copy is only made for printing, the dense engine builds its own layout (see dense_adj)
+    int (*m)[n] = NULL;
+    if (cfg.print) {
+        m = malloc(sizeof(int[n][n]));
+        if (m == NULL) {
+            printf("Not enough memory for a dense %d x %d matrix\n", n, n);
+            exit(-1);
         }
-        // Set all diagonals to 1
-        // (Likely unecessary, but may cause unplanned issues and is logical to me anyway)
-        m[i][i] = 1;
+        csr_to_dense(&g, &(m[0][0]));
     }
 
-    pthread_t threads[NUM_THREADS]; // Array of all pthread IDs
-    int starts[NUM_THREADS]; // Array of starting values for SP computation for each thread
-    int ends[NUM_THREADS]; // Array of ending values for SP computation for each thread
-    struct thread_data thread_data_array[NUM_THREADS]; // Array of parameters to pass to each thread
-
-    // Divide the workload (somewhat) evenly amongst the threads by setting their start/end indeces
-    // If NUM_THREADS > M_SIZE, this will break. I do not plan to fix that, just don't do that
-    // To fix that, check if (ends[i] = -1) and don't then dont create the thread / ignore results, etc.
-    for (int i=0; i < NUM_THREADS; i++) {
-        starts[i] = (M_SIZE / NUM_THREADS) * i;
-        ends[i] = (M_SIZE / NUM_THREADS) * (i+1) - 1;
-    }
-    // To account for M_SIZE not being evenly divisible by NUM_THREADS, the last thread handles the remaining values
-    ends[NUM_THREADS-1] = M_SIZE-1;
+    struct apsp_input in;
+    // With -o the whole matrix is never in memory, which rules out Floyd-Warshall
+    apsp_input_init(&in, cfg.engine, &g, cfg.out == NULL);
+    printf("Engine: %s\n", engine_name(in.engine));
+    if (cfg.components)
+        apsp_input_components(&in);
 
-    // Print which nodes each thread will process
-    printf("Starts = ");
-    print_row(starts,NUM_THREADS);
-    printf("Ends = ");
-    print_row(ends,NUM_THREADS);
+    // The thread count used to be a compile time NUM_THREADS that broke when it exceeded the node count
+    // Now the pool is sized at runtime, and work is handed out in chunks that idle threads can steal,
+    // so a thread that drew cheap sources (unreachable parts of the graph) helps out the others
+    int nthreads = cfg.threads > 0 ? cfg.threads : pool_default_threads();
+    int chunk = cfg.chunk > 0 ? cfg.chunk : apsp_default_chunk(&in, n, nthreads);
+    printf("Threads = %d, chunk = %d sources\n", nthreads, chunk);
 
     // Create dist matrix for all threads to share access to, and for main to access the results of the threads
-    int (*dist)[M_SIZE] = malloc(sizeof(int[M_SIZE][M_SIZE]));
-    for (int t=0; t<NUM_THREADS; t++) {
-        // Fill struct with appropriate values
-        thread_data_array[t].thread_id = t;
-        thread_data_array[t].start = starts[t];
-        thread_data_array[t].end = ends[t];
-        thread_data_array[t].m = m;
-        thread_data_array[t].d = dist;
-
-        // Create the pthread by passing the struct of parameters/outputs
-        printf("Creating thread %d\n", t);
-        int rc = pthread_create(&threads[t], NULL, dijkstra_some, (void *) &thread_data_array[t]);
-        if (rc) {
-            // Unlikely, but in case of error catch it
-            // https://hpc-tutorials.llnl.gov/posix/example_code/hello_arg2.c
-            printf("ERROR; return code from pthread_create() is %d\n", rc);
+    // It starts at a byte per entry and only widens if some distance does not fit (see distmat.h)
+    // With -o it holds nothing, the rows go to the file (through a few buffers of chunk rows) instead
+    struct dist_matrix dist;
+    if (dm_init(&dist, 0, cfg.out ? 0 : n, n))
+        exit(-1);
+    // The pool (and every thread's scratch) is made once and reused by every run
+    struct thread_pool *pool = NULL;
+    struct apsp_job data;
+    data.d = &dist;
+    data.out = NULL;
+    data.in = &in;
+    data.scratch = NULL;
+    // Every row is in dist, so the pool can hand out sources component by component (rows go to the file in order)
+    data.by_component = cfg.out == NULL;
+    // With -P the workers are pinned before they make their scratch, and each one's rows of dist go on its node
+    // Floyd-Warshall runs its own threads, which are left floating
+    struct numa_topology topo;
+    struct place_plan plan;
+    int *row_node = NULL;
+    if (in.engine != ENGINE_FW) {
+        pool = pool_create(nthreads);
+        if (pool == NULL || topo_detect(&topo) || place_threads(&plan, &topo, cfg.place, pool, 0))
             exit(-1);
+        if (cfg.place != PLACE_NONE) {
+            if (!cfg.out) {
+                row_node = row_nodes(&plan, pool, &data, n, chunk);
+                dm_place(&dist, &plan, row_node);
+            }
+            if (place_graph(&plan, &g, &in.dense))
+                printf("Could not interleave the graph over the NUMA nodes\n");
+            else if (plan.nnodes > 1)
+                printf("Graph interleaved over %d NUMA nodes\n", plan.nnodes);
+        }
+        data.scratch = malloc(nthreads * sizeof(struct sssp_scratch *));
+        if (data.scratch == NULL) {
+            printf("Not enough memory for %d threads\n", nthreads);
+            exit(-1);
+        }
+        for (int t=0; t<nthreads; t++) {
+            if ((data.scratch[t] = apsp_scratch_create(&in)) == NULL) {
+                printf("Not enough memory for the scratch of thread %d (%d nodes)\n", t, n);
+                exit(-1);
+            }
         }
     }
 
-    // Join all the threads to ensure they have completed running
-    // before accessing the results in dist
-    for (int t=0; t<NUM_THREADS; t++) {
-        pthread_join(threads[t],NULL);
+    struct bench b;
+    if (bench_init(&b, "tight", &cfg))
+        exit(-1);
+    for (int run=0; run < cfg.warmup + cfg.reps; run++) {
+        double t0 = wall_time();
+        if (cfg.out) {
+            int width = result_file_width(&g);
+            if (result_file_prepare(cfg.out, n, width))
+                exit(-1);
+            // Two buffers per thread: one being filled while the other waits for the writer thread
+            data.out = result_file_open(cfg.out, n, width, chunk, 2 * nthreads);
+            if (data.out == NULL)
+                exit(-1);
+        }
+
+        if (in.engine == ENGINE_FW) {
+            // Floyd-Warshall can't be split into rows, it runs its own threads over tiles instead
+            if (apsp_all(&in, &dist, nthreads))
+                exit(-1);
+        } else {
+            // Returns once every row is done, so dist is safe to read afterwards
+            pool_run(pool, 0, n-1, chunk, dijkstra_some, &data);
+        }
+
+        if (data.out != NULL) {
+            int used;
+            if (result_file_close(data.out, &used) || result_file_narrow(cfg.out, used))
+                exit(-1);
+            data.out = NULL;
+            b.width = used;
+        } else {
+            b.width = dist.width;
+        }
+        bench_add(&b, wall_time() - t0);
+    }
+    if (pool != NULL) {
+        pool_report(pool);
+        for (int t=0; t<nthreads; t++)
+            scratch_free(data.scratch[t]);
+        free(data.scratch);
+        pool_destroy(pool);
+        place_free(&plan);
+        topo_free(&topo);
     }
-    
-    // I disabled printing results when M_SIZE is large for many reasons
+    bench_report(&b);
+    if (cfg.check) {
+        b.wrong = cfg.out ? bench_check_file(&g, in.engine, cfg.out) : bench_check(&g, in.engine, &dist);
+        bench_check_report(&g, in.engine, b.wrong);
+    }
+    b.engine = engine_name(in.engine);
+    b.threads = nthreads;
+    if (cfg.bench && bench_record(cfg.bench, &b, &cfg, &g))
+        exit(-1);
+    bench_free(&b);
+
+    if (cfg.out)
+        printf("Distances written to %s\n", cfg.out);
+    else
+        printf("Distances stored in %d byte(s) each\n", dist.width);
+
+    // I disabled printing results when n is large for many reasons
     // 1: when large it is hard/impossible to compare at a glance
     // 2: program spends SIGNIFICANT amount of time just printing and this makes the threading
     // improvements seem worse than they really are.
     // I have included results of both small arrays (proof of working) and large ones (just the runtime for comparison)
-    if (M_SIZE <= 100) {
+    INSTR_BEGIN(output, PHASE_OUTPUT);
+    if (cfg.print) {
         printf("M = \n");
-        print_m(m);
+        print_m(n, &(m[0][0]));
         printf("Dist = \n");
-        print_m(dist);
+        if (cfg.out)
+            result_file_print(cfg.out);
+        else
+            dm_print(&dist);
     }
+    INSTR_END(output, PHASE_OUTPUT);
+    INSTR_REPORT("");
 
     free(m);
-    free(dist);
+    dm_free(&dist);
+    free(row_node);
+    apsp_input_free(&in);
+    csr_free(&g);
 
-    // Equation to get runtime in seconds, see earlier comment for source
-    clock_t end = clock();
-    double run_time = (double)(end - begin) / CLOCKS_PER_SEC;
+    double run_time = wall_time() - begin;
     // Display results
     printf("\nProgram runtime: %f\n", run_time);
-}
\ No newline at end of file
+}
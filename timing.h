@@ -0,0 +1,11 @@
+#ifndef TIMING_H
+#define TIMING_H
+
+/*
+Seconds on the monotonic clock, for timing anything that runs on more than one thread
+clock() adds up the CPU time of every thread, so it made tight look slower the more threads it had
+Only differences between two calls mean anything
+*/
+double wall_time(void);
+
+#endif